@@ -4,121 +4,232 @@
 
   #include <Arduino.h>
   #include "config.h"
+  #include "CommandMatcher.h"
+
+  //prints the bridge statistics, provided by main
+  void PrintStats(Print &p);
+
+  //prints boot and WiFi connect times, provided by main
+  void PrintBootStats(Print &p);
+
+  //applies a changed GlobalConfig, returns true if a restart is needed, provided by main
+  bool ApplyConfiguration(const ConfigDigest &previous);
+
+  class ATScanner;
+
+  //how the text behind a command prefix is handed to the handler
+  enum ATArgs {
+    ATNoArgs,     // handler gets nullptr
+    ATText        // handler gets the rest of the line behind the prefix
+  };
+
+  //one entry of the AT command table
+  struct ATCommand {
+    const char *prefix;
+    ATArgs args;
+    void (*handler)(ATScanner &scanner, const char *args);
+  };
+
+  void ATSave(ATScanner &scanner, const char *args);
+  void ATConfigQuery(ATScanner &scanner, const char *args);
+  void ATStatQuery(ATScanner &scanner, const char *args);
+  void ATBootQuery(ATScanner &scanner, const char *args);
+  void ATSleep(ATScanner &scanner, const char *args);
+  void ATConfigSet(ATScanner &scanner, const char *args);
+  void ATLoad(ATScanner &scanner, const char *args);
+
+  //the AT commands, in the order they are executed when a line contains several of them
+  //the scanner only sees command mode lines, so the "+++" in front is optional
+  constexpr ATCommand ATCommands[]= {
+    { "AT+SAVE",  ATNoArgs, ATSave },         // save current configuration as failsafe configuration
+    { "AT+CFG?",  ATNoArgs, ATConfigQuery },  // show JSON configuration string
+    { "AT+STAT?", ATNoArgs, ATStatQuery },    // show bridge statistics
+    { "AT+BOOT?", ATNoArgs, ATBootQuery },    // show boot and connect times
+    { "AT+SLEEP", ATNoArgs, ATSleep },        // send device to sleep
+    { "AT+CFG=",  ATText,   ATConfigSet },    // read JSON configuration string
+    { "AT+LOAD",  ATNoArgs, ATLoad }          // reload config.ini
+  };
+
+  constexpr size_t ATCommandCount= sizeof(ATCommands)/sizeof(ATCommands[0]);
+
+  //compile time sanity check of the command table: every entry needs a handler and
+  //an AT prefix, and no prefix may show up twice
+  template <size_t Count>
+  constexpr bool ATCommandsValid(const ATCommand (&commands)[Count]){
+    for(size_t i=0; i<Count; i++){
+      const char *p= commands[i].prefix;
+      if(!commands[i].handler || p[0]!='A' || p[1]!='T')
+        return false;
+      for(size_t j=0; j<i; j++){
+        const char *q= commands[j].prefix;
+        size_t n= 0;
+        while(p[n] && p[n]==q[n])
+          n++;
+        if(p[n]==q[n])
+          return false;
+      }
+    }
+    return true;
+  }
+
+  static_assert(ATCommandsValid(ATCommands), "invalid AT command table");
+  static_assert(ATCommandCount<=32, "too many AT commands for the found-mask");
+
+  constexpr CommandMatcher<matcherStates(ATCommands)> ATCommandMatcher(ATCommands);
+
+  //longest command line: +++AT+CFG= with the longest configuration
+  constexpr size_t ATLineSize= sizeof("+++AT+CFG=")-1+JSONSIZE;
+  static_assert(ATLineSize<=UINT16_MAX, "command line too long for m_args");
 
   //scan a given input stream for AT commands
   class ATScanner {
 
   public:
-    //look through buffer for LF and then invoke parser
+    //look through buffer for LF and invoke parser for every complete line
+    //a partial line at the end of the buffer is kept until the next call
     void scan(const uint8_t *buffer, size_t size);
 
-    //looks for AT commands and invokes the necessary action
+    //forget any partial line, e.g. when a new connection starts
+    void reset(){
+      m_pos=0;
+      m_overflow=false;
+      m_buf[0]=0x0;
+      m_state=ATCommandMatcher.Root;
+      m_found=0;
+    }
+
+    //where the results go
+    Print &out(){ return *m_p; }
+    void output(Print &p){ m_p= &p; }
+
+    //puts the device to sleep
+    void sleep(){ m_sleeproutine(); }
+
+    //invokes the handler of every AT command found in the current line
     void parse();
 
     //scan a given input stream for AT commands and send results to a print class
-    ATScanner(Print &p, void (*sf)()):m_p(p),m_sleeproutine(sf){ 
-      m_pos=0;
-      m_buf[0]=0x0;
+    ATScanner(Print &p, void (*sf)()):m_p(&p),m_sleeproutine(sf){ 
+      reset();
     }
 
   protected:
-    uint8_t m_buf[JSONSIZE];
+    uint8_t m_buf[ATLineSize];
     size_t m_pos;
-    Print &m_p;
+    bool m_overflow;    // current line did not fit into m_buf and is skipped
+    uint8_t m_state;    // ATCommandMatcher state
+    uint32_t m_found;   // AT commands found in the current line, bit mask over ATCommands
+    uint16_t m_args[ATCommandCount];  // position in m_buf just behind the first match of each command
+    Print *m_p;
     void (*m_sleeproutine)();
   };
 
 
 
-  // find first occurance of pat in txt
-  int findPattern(const char *pat, const char *txt){
-    int patLen = strlen(pat);
-    int txtLen = strlen(txt);
-    if(patLen>txtLen) //impossible to find a larger pattern in a smaller buffer
-      return -1;
+  void ATSave(ATScanner &scanner, const char *){
+    saveFailSafeConfiguration(GlobalConfig);
+    PrintFailSafeConfig(scanner.out());
+    scanner.out().println("OK");
+  }
 
-    int srchLen= txtLen-patLen; //we only need to search between start and patLen-characters before end of txt 
-    for(int t=0;t<=srchLen;t++){
-      for(int p=0;p<patLen;p++){
-        if((pat[p]==txt[t+p])){
-          if(p==(patLen-1))
-            return t;
-        }
-        else{
-          // nope, no match, move on
-          break;
-        }
 
-      }
+  void ATConfigQuery(ATScanner &scanner, const char *){
+    PrintConfig(scanner.out(), "+++AT+CFG=");
+    scanner.out().println("OK");
+  }
 
-    }
-    return -1;
+
+  void ATStatQuery(ATScanner &scanner, const char *){
+    PrintStats(scanner.out());
+    scanner.out().println("OK");
   }
 
 
+  void ATBootQuery(ATScanner &scanner, const char *){
+    PrintBootStats(scanner.out());
+    scanner.out().println("OK");
+  }
 
-  //looking for AT-command at beginning of line and process command if found
-  void ATScanner::parse(){
 
-        //save current configuration as failsafe configuration file
-    int f= 0;
-    
-    //save current configuration as failsafe configuration file
-    if(findPattern( "+++AT+SAVE", (char*)m_buf) >= 0) {
-      saveFailSafeConfiguration(GlobalConfig);
-      PrintFailSafeConfig(m_p);
-      m_p.println("OK");
-    }
+  void ATSleep(ATScanner &scanner, const char *){
+    scanner.out().print("OK");
+    scanner.sleep();
+  }
 
-    //show JSON configuration string
-    if(findPattern( "+++AT+CFG?", (char*)m_buf) >= 0) {
-       m_p.print("+++AT+CFG=");
-       PrintConfig(m_p);
-      m_p.println("OK");
-    }
 
-   //sends device to sleep
-    if(findPattern( "+++AT+SLEEP", (char*)m_buf) >= 0) {
-       m_p.print("OK");
-       m_sleeproutine();
+  void ATConfigSet(ATScanner &scanner, const char *args){
+    #ifdef DEBUG
+      Serial.println(args);
+    #endif
+    ConfigDigest previous= configDigest(GlobalConfig);
+    readConfigurationFromStream(GlobalConfig, args);
+    scanner.out().println("OK");
+    saveConfiguration(GlobalConfig);
+    PrintConfig(scanner.out());
+    scanner.out().println("OK");
+
+    //answer first, a new baudrate changes the line we might be talking on
+    if(ApplyConfiguration(previous)){
+      delay(2000);
+      ESP.reset();
     }
+  }
+
 
-    //read JSON configuration string
-    f= findPattern( "+++AT+CFG=", (char*)m_buf);
-    if (f >= 0){
-      #ifdef DEBUG
-        Serial.println((char*)m_buf+10+f);
-      #endif
-      readConfigurationFromStream(GlobalConfig, (char*)m_buf+10+f);
-      m_p.println("OK");
-      saveConfiguration(GlobalConfig);
-      PrintConfig(m_p);
-      m_p.println("OK");
+  void ATLoad(ATScanner &scanner, const char *){
+    ConfigDigest previous= configDigest(GlobalConfig);
+    reloadConfiguration(GlobalConfig);
+    PrintConfig(scanner.out(), "+++AT+CFG=");
+    scanner.out().println("OK");
+    if(ApplyConfiguration(previous)){
       delay(2000);
       ESP.reset();
     }
   }
 
 
+
+  //dispatch the AT commands found in the line through the command table
+  void ATScanner::parse(){
+    for(size_t i=0; i<ATCommandCount; i++){
+      if(m_found & (1UL<<i)) {
+        const char *args= (ATCommands[i].args==ATText ? (const char*)m_buf+m_args[i] : nullptr);
+        ATCommands[i].handler(*this, args);
+      }
+    }
+  }
+
+
   //copy characters into buf until LF is reached, then analyze line
+  //the command matcher runs along, so no line has to be searched twice
   void ATScanner::scan(const uint8_t *buffer, size_t size){
 
     for(size_t n=0; n<size; n++){               
       switch (buffer[n]) {
         case '\r': // Ignore CR
           break;
-        case '\n': // Return on new-line
-          m_buf[m_pos++] = 0x0;
-          parse();
-          m_pos = 0;  // Reset position index ready for next time
-          return;
+        case '\n': // end of line, parse it and carry on with the next one
+          if(!m_overflow && m_found){
+            m_buf[m_pos] = 0x0;
+            parse();
+          }
+          reset();  // Reset position index ready for next line
+          break;
         default:
-          if (m_pos < sizeof(m_buf)) {
+          if (m_pos < sizeof(m_buf)-1) {
               m_buf[m_pos++] = buffer[n];
+              m_state= ATCommandMatcher.step(m_state, buffer[n]);
+              uint32_t found= ATCommandMatcher.matches(m_state);
+              if(found & ~m_found){  // first match of a command, remember where its arguments start
+                for(size_t i=0; i<ATCommandCount; i++){
+                  if((found & ~m_found) & (1UL<<i))
+                    m_args[i]= m_pos;
+                }
+                m_found|= found;
+              }
           }
-          else{ //overflow
-            m_pos=0;
-            return;
+          else{ //overflow, skip the rest of this line
+            m_overflow=true;
           }
       }
     }
@@ -0,0 +1,142 @@
+#ifndef ADAPTIVESLEEP_H
+  #define ADAPTIVESLEEP_H
+
+  #include <Arduino.h>
+  #include "config.h"
+  #include "RtcStore.h"
+
+  //what was learned, kept in RTC memory across deep sleep
+  struct SleepHistory {
+    uint32_t timeout;         // current sleep timeout in s
+    uint32_t gap;             // average gap between sessions in s
+    uint32_t duration;        // average session length in s
+    uint32_t base;            // configured sleep timeout learning started from
+  };
+
+  //sleep timeout that follows the way the adapter is used
+  // - a session after a gap: the timeout grows to twice the usual gap plus
+  //   the usual session length, so a series of uploads doesn't get cut
+  // - the timeout runs out after a single session: it was a one-off
+  //   transfer and the timeout shrinks by a quarter
+  // - the timeout runs out without any session, e.g. line noise woke it up:
+  //   nothing to learn, the timeout stays
+  //always within sleepmin...sleepmax. the history lives in RTC memory, a
+  //power cycle or a new sleep setting starts over from the configured sleep timeout.
+  //gaps are measured in awake time, time spent in light sleep doesn't count.
+  //a session right after boot says nothing about the timeout: out of deep
+  //sleep the adapter only boots when the user resets it to work with it
+  class AdaptiveSleep {
+
+  public:
+    AdaptiveSleep(){
+      memset(&m_history, 0, sizeof(m_history));
+      m_enabled=false;
+      m_min=MINIMUMSLEEPTIMEOUT;
+      m_max=MINIMUMSLEEPTIMEOUT;
+      m_sessions=0;
+      m_start=0;
+      m_end=0;
+    }
+
+    //pick up the history, call once at boot
+    void begin(const Config &cfg);
+
+    //follow a changed configuration
+    void configure(const Config &cfg);
+
+    //sleep timeout to use now in s
+    uint32_t timeout() const { return m_history.timeout; }
+
+    uint32_t gap() const { return m_history.gap; }
+    uint32_t duration() const { return m_history.duration; }
+
+    //a client connected/disconnected
+    void sessionStart(uint32_t now);
+    void sessionEnd(uint32_t now);
+
+    //the timeout ran out and the adapter goes into deep sleep
+    void timedOut();
+
+  protected:
+    uint32_t clamp(uint32_t timeout) const {
+      return (timeout<m_min ? m_min : (timeout>m_max ? m_max : timeout));
+    }
+
+    void save(){ rtcSave(RtcSleep, m_history); }
+
+    SleepHistory m_history;
+    bool m_enabled;
+    uint32_t m_min;
+    uint32_t m_max;
+    uint32_t m_sessions;      // sessions since boot
+    uint32_t m_start;         // millis() of the current session's start
+    uint32_t m_end;           // millis() of the last session's end
+  };
+
+
+
+  void AdaptiveSleep::begin(const Config &cfg){
+    if(!rtcLoad(RtcSleep, m_history)){
+      memset(&m_history, 0, sizeof(m_history));
+      m_history.timeout= cfg.sleeptimeout;
+    }
+    configure(cfg);
+  }
+
+
+  void AdaptiveSleep::configure(const Config &cfg){
+    m_enabled= cfg.adaptsleep;
+    m_min= cfg.sleepmin;
+    m_max= (cfg.sleepmax<cfg.sleepmin ? cfg.sleepmin : cfg.sleepmax);
+    if(m_history.base!=(uint32_t)cfg.sleeptimeout){   // the user picked a new timeout, learn from there
+      m_history.base= cfg.sleeptimeout;
+      m_history.timeout= cfg.sleeptimeout;
+    }
+    m_history.timeout= (m_enabled ? clamp(m_history.timeout ? m_history.timeout : cfg.sleeptimeout) : cfg.sleeptimeout);
+    save();
+  }
+
+
+  void AdaptiveSleep::sessionStart(uint32_t now){
+    m_start= now;
+    m_sessions++;
+    if(!m_enabled)
+      return;
+
+    if(m_sessions>1){
+      uint32_t gap= (now-m_end)/1000;
+      m_history.gap= (m_history.gap ? (3*m_history.gap+gap)/4 : gap);
+      uint32_t target= clamp(2*m_history.gap+m_history.duration);
+      if(target>m_history.timeout){
+        m_history.timeout= target;
+        #ifdef DEBUG
+          Serial.printf("AdaptiveSleep: repeated sessions, timeout %u s\n", (unsigned)m_history.timeout);
+        #endif
+      }
+    }
+    save();
+  }
+
+
+  void AdaptiveSleep::sessionEnd(uint32_t now){
+    m_end= now;
+    if(!m_enabled)
+      return;
+
+    uint32_t duration= (now-m_start)/1000;
+    m_history.duration= (m_history.duration ? (3*m_history.duration+duration)/4 : duration);
+    save();
+  }
+
+
+  void AdaptiveSleep::timedOut(){
+    if(m_enabled && m_sessions==1){
+      m_history.timeout= clamp(m_history.timeout-m_history.timeout/4);
+      #ifdef DEBUG
+        Serial.printf("AdaptiveSleep: one-off session, timeout %u s\n", (unsigned)m_history.timeout);
+      #endif
+      save();
+    }
+  }
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef BRIDGE_H
+  #define BRIDGE_H
+
+  #include <Arduino.h>
+  #include "RingBuffer.h"
+  #include "SerialPacer.h"
+  #include "ATScanner.h"
+  #include "CommandMode.h"
+  #include "Sessions.h"
+
+  //size of each direction's ring
+  #ifndef BRIDGE_BUFFER_SIZE
+    #define BRIDGE_BUFFER_SIZE 1024
+  #endif
+
+  //max. number of bytes moved per direction and step, keeps both directions interleaved
+  #ifndef BRIDGE_SLICE
+    #define BRIDGE_SLICE 64
+  #endif
+
+  //full-duplex serial<->network bridge
+  //every service() call moves a small slice in each direction, so a long
+  //upload towards the G850 can no longer starve the serial receiver.
+  //the network side is the writer of the sessions, what the G850 sends goes
+  //to the monitors as well
+  class Bridge {
+
+  public:
+    typedef RingBuffer<BRIDGE_BUFFER_SIZE> Ring;
+
+    //net: the stream of the writer session
+    //the answers of serialscanner are queued for the G850 like any other data
+    Bridge(Stream &serial, Stream &net, Sessions &sessions, ATScanner &serialscanner, ATScanner &netscanner):
+      m_serial(serial),m_net(net),m_sessions(sessions),m_serialmode(serialscanner),m_netmode(netscanner),m_pacer(serial),m_serialout(*this){
+      serialscanner.output(m_serialout);
+      m_toSerialBytes=0;
+      m_toNetBytes=0;
+      m_lastSerialRx=0;
+      m_gapchars=0;
+      m_gap=0;
+      m_chunk=1;
+      m_release=0;
+      m_hold=false;
+      m_holdTimed=false;
+      m_holdEnd=0;
+      m_dropped=0;
+    }
+
+    //drop everything queued and pending on the serial line and return both
+    //directions to data mode, used when a new writer connects. monitors still
+    //get what the G850 sent before
+    void reset();
+
+    //keep what the G850 sends while nobody is connected and hand it to the next
+    //client instead of dropping it, used after waking up from light sleep.
+    //once the ring is full the oldest bytes make room, the serial port is read
+    //and scanned for commands all the time
+    void hold(){
+      m_hold= true;
+      m_holdTimed= false;
+    }
+
+    //the same for at most ms, e.g. just the burst that woke us up. what is held
+    //then goes, unless a client connected meanwhile
+    void hold(uint32_t ms){
+      if(m_hold && !m_holdTimed)
+        return;
+      m_hold= true;
+      m_holdTimed= true;
+      m_holdEnd= millis()+ms;
+    }
+
+    //silence around "+++" needed to switch into command mode
+    void guardTime(uint32_t ms){
+      m_serialmode.guardTime(ms);
+      m_netmode.guardTime(ms);
+    }
+
+    void onlineCommands(bool on){
+      m_serialmode.onlineCommands(on);
+      m_netmode.onlineCommands(on);
+    }
+
+    //serial line speed, used to pace the output towards the G850
+    void baudrate(uint32_t baud){
+      m_pacer.baudrate(baud);
+      m_gap= m_gapchars*m_pacer.charTime();
+    }
+
+    //hold serial data back until the line was idle for gapchars character times
+    //or chunk bytes are queued. gapchars=0 sends everything right away
+    void coalesce(uint16_t gapchars, uint16_t chunk){
+      m_gapchars= gapchars;
+      m_gap= m_gapchars*m_pacer.charTime();
+      m_chunk= (chunk<1 ? 1 : (chunk>BRIDGE_BUFFER_SIZE ? BRIDGE_BUFFER_SIZE : chunk));
+    }
+
+    //one interleaved pass over both directions, returns true if any byte was moved
+    bool service();
+
+    size_t toSerialPending() const { return m_toSerial.size(); }
+    size_t toNetPending() const { return m_toNet.head()-m_sessions.position(); }
+    uint32_t toSerialBytes() const { return m_toSerialBytes; }
+    uint32_t toNetBytes() const { return m_toNetBytes; }
+
+    //bytes kept for the next client, and the ones that made room for newer ones
+    size_t held() const { return (m_hold && !m_sessions.writer() ? m_toNet.size() : 0); }
+    uint32_t heldDropped() const { return m_dropped; }
+
+    //send everything queued for the G850 right away, e.g. an answer before
+    //the line speed changes or the adapter goes to sleep
+    void drain();
+
+    //time in ms until everything queued for the G850 has been sent
+    uint32_t toSerialDrainTime() const { return m_pacer.drainTime(m_toSerial.size()); }
+
+    //accumulated time in ms spent transmitting towards the G850
+    uint32_t toSerialBusyTime() const { return m_pacer.busyTime()/1000; }
+
+  protected:
+    //AT answers for the G850, queued behind the data towards it and paced the same way
+    class SerialOut : public Print {
+    public:
+      SerialOut(Bridge &bridge):m_bridge(bridge){}
+      size_t write(uint8_t c) override { return write(&c, 1); }
+      size_t write(const uint8_t *buffer, size_t size) override;
+      using Print::write;
+    protected:
+      Bridge &m_bridge;
+    };
+
+    //read one slice from a stream into a ring, command mode bytes go to the AT scanner instead
+    size_t pull(Stream &in, Ring &ring, CommandMode &mode);
+
+    //write as much from a ring as the serial pacer allows for this pass
+    size_t pace(Ring &ring);
+
+    //move the release mark once collected serial bytes are due to go out to the network
+    void flushDue();
+
+    Stream &m_serial;
+    Stream &m_net;
+    Sessions &m_sessions;
+    CommandMode m_serialmode;
+    CommandMode m_netmode;
+    SerialPacer m_pacer;
+    SerialOut m_serialout;
+    Ring m_toSerial;
+    Ring m_toNet;
+    uint32_t m_toSerialBytes;
+    uint32_t m_toNetBytes;
+    uint32_t m_lastSerialRx;
+    uint32_t m_gapchars;
+    uint32_t m_gap;
+    size_t m_chunk;
+    size_t m_release;     // m_toNet position up to which serial data may go out
+    bool m_hold;          // keep serial data until the next client connects
+    bool m_holdTimed;     // m_hold ends at m_holdEnd
+    uint32_t m_holdEnd;
+    uint32_t m_dropped;   // held bytes dropped because the ring was full
+  };
+
+
+
+  void Bridge::reset(){
+    if(!m_hold){
+      while(m_serial.available()>0)  {
+        m_serial.read();
+      }
+      m_release= m_toNet.head();
+    }
+    m_sessions.seek(m_hold ? m_toNet.tail() : m_toNet.head());
+    m_hold=false;
+    m_toSerial.clear();
+    m_serialmode.reset();
+    m_netmode.reset();
+  }
+
+
+  void Bridge::drain(){
+    while(!m_toSerial.empty()){
+      m_toSerialBytes+= pace(m_toSerial);
+      yield();
+    }
+  }
+
+
+  //a full ring is sent ahead, as a handler doesn't return to the main loop
+  //before its answer is complete
+  size_t Bridge::SerialOut::write(const uint8_t *buffer, size_t size){
+    size_t done= 0;
+    while(true){
+      done+= m_bridge.m_toSerial.push(buffer+done, size-done);
+      if(done==size)
+        return done;
+      m_bridge.m_toSerialBytes+= m_bridge.pace(m_bridge.m_toSerial);
+      yield();
+    }
+  }
+
+
+  size_t Bridge::pull(Stream &in, Ring &ring, CommandMode &mode){
+    int avail= in.available();
+    if(avail<=0)
+      return 0;
+
+    //keep room for "+++" that may be released as data
+    size_t size= ring.space();
+    size= (size>3 ? size-3 : 0);
+    size= (size>(size_t)avail ? (size_t)avail : size);
+    size= (size>BRIDGE_SLICE ? BRIDGE_SLICE : size);
+    if(size==0)   //ring full, leave the bytes where they are until the other side caught up
+      return 0;
+
+    uint8_t buffer[BRIDGE_SLICE];
+    size= in.readBytes(buffer, size);
+    mode.filter(buffer, size, ring, millis());
+    return size;
+  }
+
+
+  size_t Bridge::pace(Ring &ring){
+    const uint8_t *src;
+    size_t size= ring.peek(&src);
+    if(size==0)
+      return 0;
+
+    size= m_pacer.write(src, size);
+    ring.consume(size);
+    return size;
+  }
+
+
+  void Bridge::flushDue(){
+    //once started, a flush releases everything that was collected up to then,
+    //bytes trickling in meanwhile wait until the writer got it and for the next gap or chunk,
+    //or until the ring is too full for another slice
+    size_t pending= m_toNet.head()-m_release;
+    if(pending>0 && m_sessions.delivered(m_release) &&
+       (pending>=m_chunk || m_toNet.space()<=BRIDGE_SLICE+3 ||
+        (uint32_t)(micros()-m_lastSerialRx)>=m_gap))
+      m_release= m_toNet.head();
+  }
+
+
+  bool Bridge::service(){
+    size_t moved= 0;
+    bool writer= m_sessions.writer();
+
+    uint32_t now= millis();
+    if(m_hold && m_holdTimed && !writer && (int32_t)(now-m_holdEnd)>=0)
+      m_hold= false;
+    m_netmode.poll(m_toSerial, now);
+    m_serialmode.poll(m_toNet, now);
+
+    size_t n= (writer ? pull(m_net, m_toSerial, m_netmode) : 0);
+    if(n)
+      m_sessions.touch(now);
+    moved+= n;
+
+    n= pull(m_serial, m_toNet, m_serialmode);
+    if(n)
+      m_lastSerialRx= micros();
+    moved+= n;
+
+    n= pace(m_toSerial);
+    m_toSerialBytes+= n;
+    moved+= n;
+
+    if(writer || m_sessions.any() || m_hold){
+      //monitors get it right away, the next writer gets what is held
+      size_t tail= m_toNet.tail();
+      flushDue();
+      n= m_sessions.send(m_toNet, m_release, BRIDGE_SLICE+3, m_hold);
+      if(m_hold && !writer)
+        m_dropped+= m_toNet.tail()-tail;
+      m_toNetBytes+= n;
+      moved+= n;
+    } else {
+      //nobody listening, serial data was only of interest for the AT scanner
+      m_toNet.clear();
+      m_release= m_toNet.head();
+    }
+
+    return moved>0;
+  }
+
+#endif
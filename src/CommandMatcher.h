@@ -0,0 +1,105 @@
+#ifndef COMMANDMATCHER_H
+  #define COMMANDMATCHER_H
+
+  #include <Arduino.h>
+
+  //number of automaton states needed for a table of entries with a prefix member,
+  //i.e. distinct prefixes of all patterns plus the root
+  template <class Entry, size_t Count>
+  constexpr size_t matcherStates(const Entry (&entries)[Count]){
+    size_t states= 1;
+    for(size_t p=0; p<Count; p++){
+      for(size_t len=1; entries[p].prefix[len-1]; len++){
+        //count a prefix only at its first occurrence
+        bool seen= false;
+        for(size_t q=0; q<p && !seen; q++){
+          size_t n= 0;
+          while(n<len && entries[q].prefix[n] && entries[q].prefix[n]==entries[p].prefix[n])
+            n++;
+          seen= (n==len);
+        }
+        if(!seen)
+          states++;
+      }
+    }
+    return states;
+  }
+
+  //Aho-Corasick automaton over a fixed set of (up to 32) patterns, built at compile time
+  //the automaton is shared, callers keep their own state and advance it one
+  //character at a time, so every character is looked at exactly once no matter
+  //how many patterns there are or where in the line they occur
+  template <size_t States>
+  class CommandMatcher {
+    static_assert(States<=256, "CommandMatcher: too many states for uint8_t");
+
+  public:
+    //the start state
+    static constexpr uint8_t Root= 0;
+
+    //entries need a prefix member, patterns are reported by their index in the table
+    template <class Entry, size_t Count>
+    constexpr CommandMatcher(const Entry (&entries)[Count]):
+      m_char{},m_child{},m_sibling{},m_fail{},m_out{}{
+      static_assert(Count<=32, "CommandMatcher: at most 32 patterns");
+      size_t count= 1;
+
+      //build the trie
+      for(size_t p=0; p<Count; p++){
+        uint8_t state= Root;
+        for(const char *c=entries[p].prefix; *c; c++){
+          uint8_t t= m_child[state];
+          while(t!=Root && m_char[t]!=(uint8_t)*c)
+            t= m_sibling[t];
+          if(t==Root){
+            t= count++;
+            m_char[t]= *c;
+            m_sibling[t]= m_child[state];
+            m_child[state]= t;
+          }
+          state= t;
+        }
+        m_out[state]|= (1UL<<p);
+      }
+
+      //breadth first over the trie to fill in the failure links
+      uint8_t queue[States]{};
+      size_t head= 0, tail= 0;
+      for(uint8_t t=m_child[Root]; t!=Root; t=m_sibling[t])
+        queue[tail++]= t;
+
+      while(head<tail){
+        uint8_t state= queue[head++];
+        for(uint8_t t=m_child[state]; t!=Root; t=m_sibling[t]){
+          m_fail[t]= step(m_fail[state], m_char[t]);
+          m_out[t]|= m_out[m_fail[t]];
+          queue[tail++]= t;
+        }
+      }
+    }
+
+    //advance from state by one character and return the new state
+    constexpr uint8_t step(uint8_t state, uint8_t c) const {
+      while(true){
+        for(uint8_t t=m_child[state]; t!=Root; t=m_sibling[t]){
+          if(m_char[t]==c)
+            return t;
+        }
+        if(state==Root)
+          return Root;
+        state= m_fail[state];
+      }
+    }
+
+    //bit mask of all patterns ending in state
+    constexpr uint32_t matches(uint8_t state) const { return m_out[state]; }
+
+  protected:
+    uint8_t m_char[States];       // character leading into the state
+    uint8_t m_child[States];      // first child, Root if none
+    uint8_t m_sibling[States];    // next child of the same parent, Root if none
+    uint8_t m_fail[States];       // longest proper suffix that is also a prefix
+    uint32_t m_out[States];       // patterns ending here, including the ones reached via m_fail
+  };
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef COMMANDMODE_H
+  #define COMMANDMODE_H
+
+  #include <Arduino.h>
+  #include "ATScanner.h"
+
+  //Hayes style data/command mode switch for one direction of the bridge
+  //
+  //in data mode bytes are forwarded untouched and are not looked at, apart from
+  //the first byte after a pause. "+++" only counts as escape when the line was
+  //silent for the guard time before it. After the escape either
+  // - the line stays silent for another guard time: command mode, answered with OK.
+  //   every line is an AT command until ATO returns to data mode
+  // - "AT..." follows right away: that single line is an AT command (online command),
+  //   e.g. "+++AT+CFG?" sent from a file after a pause. Only when online commands are
+  //   turned on, as a pause followed by "+++AT" can also turn up in binary data
+  //anything else and the "+++" is forwarded as ordinary data
+  class CommandMode {
+
+  public:
+    enum Mode {Data, Escape, Online, Command};
+
+    CommandMode(ATScanner &scanner):m_scanner(scanner){
+      m_guard= 1000;
+      m_online= false;
+      reset();
+    }
+
+    //back to data mode, e.g. when a new connection starts
+    void reset(){
+      m_mode= Data;
+      m_plus= 0;
+      m_last= millis()-m_guard;
+      m_ato= 0;
+      m_scanner.reset();
+    }
+
+    //silence in ms needed before and after "+++"
+    void guardTime(uint32_t ms){ m_guard= ms; }
+
+    //run "+++AT..." without the guard time after "+++" as a single command
+    void onlineCommands(bool on){ m_online= on; }
+
+    Mode mode() const { return m_mode; }
+
+    //split a received chunk into data, which goes into ring, and command bytes,
+    //which go to the AT scanner
+    template <class Ring>
+    void filter(const uint8_t *buffer, size_t size, Ring &ring, uint32_t now);
+
+    //call regularly, finishes an escape sequence once the guard time after it passed
+    template <class Ring>
+    void poll(Ring &ring, uint32_t now);
+
+  protected:
+    static constexpr uint8_t Plus= '+';
+
+    //forward the pluses that turned out not to be an escape sequence
+    template <class Ring>
+    void release(Ring &ring){
+      for(; m_plus>0; m_plus--)
+        ring.push(&Plus, 1);
+    }
+
+    //escape complete, switch to command mode
+    void enterCommand(){
+      m_mode= Command;
+      m_plus= 0;
+      m_ato= 0;
+      m_scanner.reset();
+      m_scanner.out().println("OK");
+    }
+
+    //hand a byte to the AT scanner, watching for ATO in command mode
+    void command(uint8_t c);
+
+    ATScanner &m_scanner;
+    Mode m_mode;
+    uint8_t m_plus;       // number of '+' held back while an escape may be under way
+    uint8_t m_ato;        // progress of "ATO" at the start of a line in command mode
+    uint32_t m_guard;
+    bool m_online;        // online commands allowed
+    uint32_t m_last;      // time the last byte was received
+  };
+
+
+
+  void CommandMode::command(uint8_t c){
+    m_scanner.scan(&c, 1);
+
+    if(m_mode==Online){
+      if(c=='\n')         // online command is a single line
+        m_mode= Data;
+      return;
+    }
+
+    switch(c){
+      case '\r':
+        break;
+      case '\n':
+        if(m_ato==3){     // line was just "ATO"
+          m_mode= Data;
+          m_scanner.out().println("OK");
+        }
+        m_ato= 0;
+        break;
+      default:
+        m_ato= ((m_ato<3 && c=="ATO"[m_ato]) ? m_ato+1 : 0xff);
+    }
+  }
+
+
+  template <class Ring>
+  void CommandMode::filter(const uint8_t *buffer, size_t size, Ring &ring, uint32_t now){
+    if(size==0)
+      return;
+
+    bool silent= (now-m_last)>=m_guard;
+    m_last= now;
+
+    //hot path: ordinary data without a pause in front of it
+    if(m_mode==Data && m_plus==0 && (!silent || buffer[0]!=Plus)){
+      ring.push(buffer, size);
+      return;
+    }
+
+    for(size_t n=0; n<size; n++){
+      uint8_t c= buffer[n];
+      switch(m_mode){
+        case Data:
+          if(c==Plus && (m_plus>0 || (n==0 && silent))){
+            if(++m_plus==3)
+              m_mode= Escape;
+          } else {
+            release(ring);
+            ring.push(buffer+n, size-n);  //rest of the chunk can't contain another escape
+            return;
+          }
+          break;
+
+        case Escape:
+          if(n==0 && silent){             // guard time passed, poll() just didn't notice yet
+            enterCommand();
+            command(c);
+          } else if(m_online && (c=='A' || c=='a')){   // online command
+            m_mode= Online;
+            m_plus= 0;
+            m_scanner.reset();
+            command(c);
+          } else {
+            m_mode= Data;
+            release(ring);
+            ring.push(buffer+n, size-n);
+            return;
+          }
+          break;
+
+        case Online:
+        case Command:
+          command(c);
+          break;
+      }
+    }
+  }
+
+
+  template <class Ring>
+  void CommandMode::poll(Ring &ring, uint32_t now){
+    if(m_plus==0 || (now-m_last)<m_guard)
+      return;
+
+    if(m_mode==Escape){
+      enterCommand();
+    } else {                              // less than three '+' followed by a pause
+      release(ring);
+    }
+  }
+
+#endif
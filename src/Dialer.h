@@ -0,0 +1,296 @@
+#ifndef DIALER_H
+  #define DIALER_H
+
+  #include <Arduino.h>
+  #include <ESP8266WiFi.h>
+  #include <lwip/dns.h>
+  #include <lwip/tcp.h>
+  #include <include/ClientContext.h>
+  #include "config.h"
+  #include "RtcStore.h"
+
+  //ms a name lookup or a connect may take
+  #ifndef DIAL_TIMEOUT
+    #define DIAL_TIMEOUT 3000
+  #endif
+
+  //wait in ms after the first failed attempt, doubles with every further one up to DIAL_BACKOFF_MAX
+  #ifndef DIAL_BACKOFF_MIN
+    #define DIAL_BACKOFF_MIN 1000
+  #endif
+  #ifndef DIAL_BACKOFF_MAX
+    #define DIAL_BACKOFF_MAX 60000
+  #endif
+
+  //resolved address of the remote server, kept in RTC memory
+  struct DnsCache {
+    uint32_t host;            // crc of the host name the entry belongs to
+    uint32_t ip;
+  };
+
+  //a WiFiClient for a connection lwIP made, WiFiServer does the same for accepted ones
+  class DialedClient : public WiFiClient {
+  public:
+    DialedClient(ClientContext *context):WiFiClient(context){}
+  };
+
+  //outbound connection to the remote server of the configuration
+  //dial() resolves the host name and connects. the address is kept in RTC
+  //memory, so after deep sleep the connect goes straight to it without a DNS
+  //lookup. the cache is dropped when a connect to the cached address fails,
+  //the next attempt resolves the name again. failed attempts back off
+  //exponentially from DIAL_BACKOFF_MIN to DIAL_BACKOFF_MAX.
+  //nothing blocks: the lookup and the connect run in lwIP and report back
+  //through callbacks, dial() is polled from the main loop and only looks at
+  //how far they got, so the bridge keeps reading the serial port meanwhile
+  class Dialer {
+
+  public:
+    Dialer(){
+      m_name="";
+      m_port=0;
+      m_host=0;
+      m_backoff=0;
+      m_next=0;
+      m_connects=0;
+      m_failures=0;
+      m_cached=0;
+      m_state=Idle;
+      m_since=0;
+      m_ip=0;
+      m_fromCache=false;
+      m_pcb=NULL;
+      m_context=NULL;
+    }
+
+    //follow the remote host and port of the configuration, resets the backoff
+    void configure(const Config &cfg);
+
+    //true if a remote server is configured
+    bool enabled() const { return m_port!=0; }
+
+    //start or go on connecting to the remote server, unless an earlier attempt
+    //failed too recently or WiFi is down. returns true with client connected
+    bool dial(WiFiClient &client, uint32_t now);
+
+    //give up an attempt that is under way, no failure
+    void cancel();
+
+    //an attempt is under way
+    bool dialing() const { return m_state!=Idle; }
+
+    //lwIP reported back, the next dial() takes the attempt a step further
+    bool ready() const { return m_state==Connected || m_state==Failed || (m_state==Resolving && m_ip!=0); }
+
+    uint32_t connects() const { return m_connects; }
+    uint32_t failures() const { return m_failures; }
+
+    //connects that skipped the DNS lookup
+    uint32_t cached() const { return m_cached; }
+
+  protected:
+    enum State {Idle, Resolving, Connecting, Connected, Failed};
+
+    //start the attempt: the address from RTC memory or a DNS lookup
+    bool resolve();
+
+    //start the connect to m_ip
+    bool connect(uint32_t now);
+
+    void failed(uint32_t now);
+
+    //lwIP callbacks, arg is the Dialer
+    static void found(const char *name, const ip_addr_t *ipaddr, void *arg);
+    static err_t connected(void *arg, struct tcp_pcb *pcb, err_t err);
+    static void error(void *arg, err_t err);
+
+    const char *m_name;
+    uint16_t m_port;
+    uint32_t m_host;          // crc of m_name
+    uint32_t m_backoff;       // ms to wait after the next failure
+    uint32_t m_next;          // millis() the next attempt is allowed
+    uint32_t m_connects;
+    uint32_t m_failures;
+    uint32_t m_cached;
+    State m_state;
+    uint32_t m_since;         // millis() the current step started
+    uint32_t m_ip;            // address of the remote server, 0 while the lookup runs
+    bool m_fromCache;         // m_ip came from RTC memory
+    tcp_pcb *m_pcb;           // connect under way
+    ClientContext *m_context; // the connection, until dial() hands it over
+  };
+
+
+
+  void Dialer::configure(const Config &cfg){
+    cancel();
+    m_name= cfg.remotehost;
+    m_port= (*cfg.remotehost ? cfg.remoteport : 0);
+    m_host= crc32((const uint8_t*)cfg.remotehost, strlen(cfg.remotehost));
+    m_backoff= DIAL_BACKOFF_MIN;
+    m_next= millis();
+  }
+
+
+  bool Dialer::resolve(){
+    DnsCache cache;
+    m_fromCache= (rtcLoad(RtcDns, cache) && cache.host==m_host);
+    if(m_fromCache){
+      m_ip= cache.ip;
+      return true;
+    }
+
+    //answered right away for an IP address or a name lwIP still knows
+    m_ip= 0;
+    ip_addr_t addr;
+    err_t err= dns_gethostbyname(m_name, &addr, found, this);
+    if(err==ERR_OK)
+      m_ip= IPAddress(&addr);
+    return (err==ERR_OK || err==ERR_INPROGRESS);
+  }
+
+
+  void Dialer::found(const char *name, const ip_addr_t *ipaddr, void *arg){
+    Dialer *d= (Dialer*)arg;
+    //a lookup that was given up or is for a name configured before
+    if(d->m_state!=Resolving || strcmp(name, d->m_name)!=0)
+      return;
+    if(ipaddr)
+      d->m_ip= IPAddress(ipaddr);
+    else
+      d->m_state= Failed;     // no such host
+  }
+
+
+  bool Dialer::connect(uint32_t now){
+    tcp_pcb *pcb= tcp_new();
+    if(!pcb)
+      return false;
+    ip_addr_t addr;
+    ip_addr_set_ip4_u32(&addr, m_ip);
+    tcp_arg(pcb, this);
+    tcp_err(pcb, error);
+    if(tcp_connect(pcb, &addr, m_port, connected)!=ERR_OK){
+      tcp_err(pcb, NULL);
+      tcp_abort(pcb);
+      return false;
+    }
+    m_pcb= pcb;
+    m_state= Connecting;
+    m_since= now;
+    return true;
+  }
+
+
+  err_t Dialer::connected(void *arg, struct tcp_pcb *pcb, err_t){
+    Dialer *d= (Dialer*)arg;
+    //takes the pcb over and sets its own callbacks, so data arriving
+    //before dial() hands it on is kept
+    d->m_context= new (std::nothrow) ClientContext(pcb, nullptr, nullptr);
+    d->m_pcb= NULL;
+    if(!d->m_context){
+      tcp_err(pcb, NULL);
+      tcp_abort(pcb);
+      d->m_state= Failed;
+      return ERR_ABRT;
+    }
+    d->m_state= Connected;
+    return ERR_OK;
+  }
+
+
+  void Dialer::error(void *arg, err_t err){
+    Dialer *d= (Dialer*)arg;
+    d->m_pcb= NULL;           // already freed by lwIP
+    d->m_state= Failed;
+    #ifdef DEBUG
+      Serial.printf("Dialer: connect error %d\n", (int)err);
+    #endif
+  }
+
+
+  void Dialer::cancel(){
+    if(m_pcb){
+      tcp_err(m_pcb, NULL);
+      tcp_abort(m_pcb);
+      m_pcb= NULL;
+    }
+    if(m_context){
+      DialedClient dropped(m_context);    // frees the context when it goes
+      dropped.abort();
+      m_context= NULL;
+    }
+    m_state= Idle;
+  }
+
+
+  void Dialer::failed(uint32_t now){
+    m_failures++;
+    m_next= now+m_backoff;
+    m_backoff= (m_backoff>DIAL_BACKOFF_MAX/2 ? DIAL_BACKOFF_MAX : 2*m_backoff);
+    #ifdef DEBUG
+      Serial.printf("Dialer: failed, next attempt in %u ms\n", (unsigned)(m_next-now));
+    #endif
+  }
+
+
+  bool Dialer::dial(WiFiClient &client, uint32_t now){
+    switch(m_state){
+      case Idle:
+        if(!enabled() || (int32_t)(now-m_next)<0 || WiFi.status()!=WL_CONNECTED)
+          return false;
+        m_state= Resolving;
+        m_since= now;
+        if(!resolve()){
+          m_state= Idle;
+          failed(now);
+        }
+        return false;
+
+      case Resolving:
+        if(m_ip==0){
+          if(now-m_since>=DIAL_TIMEOUT){
+            m_state= Idle;
+            failed(now);
+          }
+          return false;
+        }
+        if(!m_fromCache){
+          DnsCache cache= {m_host, m_ip};
+          rtcSave(RtcDns, cache);
+        }
+        if(!connect(now)){
+          m_state= Idle;
+          failed(now);
+        }
+        return false;
+
+      case Connecting:
+        if(now-m_since<DIAL_TIMEOUT)
+          return false;
+        cancel();
+        // fall through
+      case Failed:
+        m_state= Idle;
+        if(m_fromCache)
+          rtcClear(RtcDns);       // the server may have moved, look it up again
+        failed(now);
+        return false;
+
+      case Connected:
+        break;
+    }
+
+    client= DialedClient(m_context);
+    m_context= NULL;
+    m_state= Idle;
+    #ifdef DEBUG
+      Serial.printf("Dialer: connected to %s:%u%s\n", m_name, (unsigned)m_port, (m_fromCache ? " (cached)" : ""));
+    #endif
+    m_connects++;
+    m_cached+= m_fromCache;
+    m_backoff= DIAL_BACKOFF_MIN;
+    return true;
+  }
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef FASTCONNECT_H
+  #define FASTCONNECT_H
+
+  #include <Arduino.h>
+  #include <ESP8266WiFi.h>
+  #include "config.h"
+  #include "RtcStore.h"
+
+  //time in ms a directed reconnect gets before falling back to a full scan
+  #ifndef FASTCONNECT_TIMEOUT
+    #define FASTCONNECT_TIMEOUT 3000
+  #endif
+
+  //access point and lease of the last good connection, kept in RTC memory
+  struct WiFiCache {
+    uint32_t network;         // crc of ssid and password the entry belongs to
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t mask;
+    uint32_t dns;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+  };
+
+  //WiFi connection that doesn't wait for scan and DHCP after deep sleep
+  //the first connect after power-up goes the normal way and remembers
+  //BSSID, channel and lease. after waking up begin() connects straight to that
+  //access point with the old lease as static configuration. if that doesn't
+  //work within FASTCONNECT_TIMEOUT the cache is dropped and a full scan with
+  //DHCP follows.
+  //how long the adapter slept isn't known, the RTC clock starts over with the
+  //reset that ends deep sleep. so once connected with the old lease, DHCP is
+  //started in the background: it renews the lease, usually for the same
+  //address, or moves to a new one before the old one collides with another host
+  //a complete static profile in the configuration (ip, gw and mask) replaces
+  //DHCP and the cached lease altogether, an incomplete one is ignored
+  class FastConnect {
+
+  public:
+    FastConnect(){
+      m_fast=false;
+      m_start=0;
+      m_connected=0;
+      m_reused=false;
+      m_renew=false;
+    }
+
+    //start connecting with the credentials of cfg
+    void begin(const Config &cfg);
+
+    //call from the got IP event, remembers the connection for the next wake up
+    void connected(const Config &cfg);
+
+    //call regularly, falls back to a full scan when the directed reconnect fails
+    //and renews a reused lease
+    void poll(const Config &cfg);
+
+    //true if the last connect used the cached access point
+    bool fast() const { return m_fast; }
+
+    //true if the configuration holds a usable static profile
+    static bool isStatic(const Config &cfg){
+      IPAddress ip, gateway, mask, dns;
+      return staticProfile(cfg, ip, gateway, mask, dns);
+    }
+
+    //ms after boot the station got its IP, 0 while not connected yet
+    uint32_t connectTime() const { return m_connected; }
+
+  protected:
+    static uint32_t network(const Config &cfg){
+      uint32_t crc= crc32((const uint8_t*)cfg.wifissid, strlen(cfg.wifissid));
+      return crc^crc32((const uint8_t*)cfg.wifipassword, strlen(cfg.wifipassword));
+    }
+
+    //addresses of the static profile, false if there is none or it is incomplete
+    static bool staticProfile(const Config &cfg, IPAddress &ip, IPAddress &gateway, IPAddress &mask, IPAddress &dns);
+
+    //static profile if there is one, else the given addresses (all unset means DHCP)
+    static void configure(const Config &cfg, IPAddress ip, IPAddress gateway, IPAddress mask, IPAddress dns);
+
+    //normal connect: scan for the ssid and ask for a lease
+    void scan(const Config &cfg);
+
+    bool m_fast;
+    uint32_t m_start;
+    uint32_t m_connected;
+    bool m_reused;            // the directed connect uses the cached lease
+    bool m_renew;             // connected with it, DHCP has to be started
+  };
+
+
+
+  void FastConnect::begin(const Config &cfg){
+    m_start= millis();
+    m_connected= 0;
+    m_reused= false;
+    m_renew= false;
+
+    WiFiCache cache;
+    m_fast= rtcLoad(RtcWiFi, cache) && cache.network==network(cfg);
+    if(!m_fast){
+      scan(cfg);
+      return;
+    }
+
+    #ifdef DEBUG
+      Serial.printf("FastConnect: channel %u\n", cache.channel);
+    #endif
+    m_reused= (cache.ip && !isStatic(cfg));
+    configure(cfg, IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.mask), IPAddress(cache.dns));
+    WiFi.begin(cfg.wifissid, cfg.wifipassword, cache.channel, cache.bssid);
+  }
+
+
+  bool FastConnect::staticProfile(const Config &cfg, IPAddress &ip, IPAddress &gateway, IPAddress &mask, IPAddress &dns){
+    if(!ip.fromString(cfg.staticip) || !gateway.fromString(cfg.staticgateway) || !mask.fromString(cfg.staticmask))
+      return false;
+    if(!dns.fromString(cfg.staticdns))
+      dns= gateway;
+    return true;
+  }
+
+
+  void FastConnect::configure(const Config &cfg, IPAddress ip, IPAddress gateway, IPAddress mask, IPAddress dns){
+    IPAddress sip, sgateway, smask, sdns;
+    if(staticProfile(cfg, sip, sgateway, smask, sdns)){
+      ip= sip;
+      gateway= sgateway;
+      mask= smask;
+      dns= sdns;
+    }
+    #ifdef DEBUG
+      Serial.printf("FastConnect: ip %s\n", (ip.isSet() ? ip.toString().c_str() : "DHCP"));
+    #endif
+    WiFi.config(ip, gateway, mask, dns);
+  }
+
+
+  void FastConnect::scan(const Config &cfg){
+    configure(cfg, IPAddress(), IPAddress(), IPAddress(), IPAddress());
+    WiFi.begin(cfg.wifissid, cfg.wifipassword);
+  }
+
+
+  void FastConnect::connected(const Config &cfg){
+    if(!m_connected)
+      m_connected= millis();
+    if(m_reused){             // not from the event handler, see poll()
+      m_reused= false;
+      m_renew= true;
+    }
+
+    WiFiCache cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.network= network(cfg);
+    if(!isStatic(cfg)){       // only a lease is worth remembering, all zero means DHCP
+      cache.ip= WiFi.localIP();
+      cache.gateway= WiFi.gatewayIP();
+      cache.mask= WiFi.subnetMask();
+      cache.dns= WiFi.dnsIP();
+    }
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel= WiFi.channel();
+    rtcSave(RtcWiFi, cache);
+  }
+
+
+  void FastConnect::poll(const Config &cfg){
+    if(m_renew){
+      #ifdef DEBUG
+        Serial.println("FastConnect: renewing the cached lease");
+      #endif
+      m_renew= false;
+      WiFi.config(IPAddress(), IPAddress(), IPAddress(), IPAddress());   // DHCP, the address stays until it answers
+    }
+
+    if(!m_fast || m_connected || (millis()-m_start)<FASTCONNECT_TIMEOUT)
+      return;
+
+    #ifdef DEBUG
+      Serial.println("FastConnect: cached access point failed, scanning");
+    #endif
+    rtcClear(RtcWiFi);
+    m_fast= false;
+    m_reused= false;
+    WiFi.disconnect();
+    scan(cfg);
+  }
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef JSONREADER_H
+  #define JSONREADER_H
+
+  #include <Arduino.h>
+
+  //max. nesting of objects/arrays inside the top level object, deeper values are an error
+  #ifndef JSONREADER_DEPTH
+    #define JSONREADER_DEPTH 32
+  #endif
+
+  //pull style reader for a flat JSON object like {"key":value,...}
+  //walks the text in place, one member per next() call, without building a
+  //document: the caller looks at the key and copies the value straight to
+  //its destination. nested objects and arrays are checked and skipped.
+  //once an error was found next() keeps returning false
+  class JsonReader {
+
+  public:
+    enum Type {None, String, Number, Literal, Object, Array};
+
+    JsonReader(const char *json):m_p(json){
+      m_key=NULL;
+      m_keylen=0;
+      m_value=NULL;
+      m_type=None;
+      m_started=false;
+      m_done=false;
+      m_error=false;
+    }
+
+    //advance to the next member, false at the end of the object or on a syntax error
+    bool next();
+
+    //true if the text is not a well formed JSON object
+    bool error() const { return m_error; }
+
+    //true if the current member has the given key (keys are compared as written)
+    bool key(const char *name) const {
+      return m_key && strlen(name)==m_keylen && !memcmp(m_key, name, m_keylen);
+    }
+
+    Type type() const { return m_type; }
+
+    //current value as integer, saturated to the int32_t range. fractions are
+    //truncated, false if the value is not a plain number
+    bool integer(int32_t &value) const;
+
+    //copy the current string value to dst, escapes decoded and truncated to
+    //size-1 bytes, false if the value is not a string
+    bool string(char *dst, size_t size) const;
+
+  protected:
+    void skipSpace(){ while(*m_p==' ' || *m_p=='\t' || *m_p=='\r' || *m_p=='\n') m_p++; }
+    bool fail(){ m_error=true; m_done=true; m_key=NULL; m_type=None; return false; }
+
+    //closing brace of the object, nothing but white space may follow
+    bool finish(){
+      m_p++;
+      skipSpace();
+      m_done= true;
+      m_key= NULL;
+      m_type= None;
+      return (*m_p ? fail() : false);
+    }
+
+    //move m_p past one string, number or literal, false if it is malformed
+    bool skipString();
+    bool skipNumber();
+    bool skipLiteral(const char *word);
+
+    //move m_p past one value of any type, nested ones included
+    bool skipValue();
+
+    //value of the hex digit c, -1 if it is none
+    static int hex(char c){
+      return (c>='0' && c<='9' ? c-'0' : (c>='a' && c<='f' ? c-'a'+10 : (c>='A' && c<='F' ? c-'A'+10 : -1)));
+    }
+
+    const char *m_p;          // read position
+    const char *m_key;        // current key, without quotes, not terminated
+    size_t m_keylen;
+    const char *m_value;      // first character of the current value
+    Type m_type;
+    bool m_started;
+    bool m_done;
+    bool m_error;
+  };
+
+
+
+  bool JsonReader::next(){
+    if(m_done)
+      return false;
+
+    skipSpace();
+    if(!m_started){
+      m_started= true;
+      if(*m_p!='{')
+        return fail();
+      m_p++;
+      skipSpace();
+      if(*m_p=='}')
+        return finish();
+    } else {
+      if(*m_p=='}')
+        return finish();
+      if(*m_p!=',')
+        return fail();
+      m_p++;
+      skipSpace();
+    }
+
+    //key
+    if(*m_p!='"')
+      return fail();
+    m_key= m_p+1;
+    if(!skipString())
+      return fail();
+    m_keylen= m_p-1-m_key;
+
+    skipSpace();
+    if(*m_p!=':')
+      return fail();
+    m_p++;
+    skipSpace();
+
+    //value, remembered and skipped, the caller picks it up from m_value
+    m_value= m_p;
+    switch(*m_p){
+      case '"': m_type= String; break;
+      case '{': m_type= Object; break;
+      case '[': m_type= Array; break;
+      case 't': case 'f': case 'n': m_type= Literal; break;
+      default:  m_type= Number;
+    }
+    if(!skipValue())
+      return fail();
+
+    skipSpace();
+    if(*m_p!=',' && *m_p!='}')
+      return fail();
+    return true;
+  }
+
+
+  bool JsonReader::skipString(){
+    m_p++;              // opening quote
+    while(*m_p!='"'){
+      if((uint8_t)*m_p<0x20)          // end of text or raw control character
+        return false;
+      if(*m_p=='\\'){
+        m_p++;
+        if(*m_p=='u'){
+          for(uint8_t n=0; n<4; n++){
+            if(hex(*++m_p)<0)
+              return false;
+          }
+        } else if(!strchr("\"\\/bfnrt", *m_p) || !*m_p){
+          return false;
+        }
+      }
+      m_p++;
+    }
+    m_p++;              // closing quote
+    return true;
+  }
+
+
+  bool JsonReader::skipNumber(){
+    const char *start;
+    if(*m_p=='-')
+      m_p++;
+    if(*m_p=='0'){
+      m_p++;
+    } else {
+      for(start=m_p; *m_p>='0' && *m_p<='9'; m_p++);
+      if(m_p==start)
+        return false;
+    }
+    if(*m_p=='.'){
+      for(start=++m_p; *m_p>='0' && *m_p<='9'; m_p++);
+      if(m_p==start)
+        return false;
+    }
+    if(*m_p=='e' || *m_p=='E'){
+      m_p++;
+      if(*m_p=='+' || *m_p=='-')
+        m_p++;
+      for(start=m_p; *m_p>='0' && *m_p<='9'; m_p++);
+      if(m_p==start)
+        return false;
+    }
+    return true;
+  }
+
+
+  bool JsonReader::skipLiteral(const char *word){
+    size_t len= strlen(word);
+    if(strncmp(m_p, word, len))
+      return false;
+    m_p+= len;
+    return true;
+  }
+
+
+  bool JsonReader::skipValue(){
+    //nested objects and arrays are walked without recursion, one bit per
+    //level tells whether it is an object (1) or an array (0)
+    uint32_t stack= 0;
+    uint8_t depth= 0;
+    static_assert(JSONREADER_DEPTH<=32, "JsonReader: nesting is tracked in 32 bits");
+
+    while(true){
+      bool ok;
+      switch(*m_p){
+        case '"': ok= skipString(); break;
+        case 't': ok= skipLiteral("true"); break;
+        case 'f': ok= skipLiteral("false"); break;
+        case 'n': ok= skipLiteral("null"); break;
+        case '{':
+        case '[':
+          if(depth==JSONREADER_DEPTH)
+            return false;
+          stack= (stack<<1)|(*m_p=='{');
+          depth++;
+          m_p++;
+          skipSpace();
+          if(*m_p==(stack&1 ? '}' : ']')){    // empty
+            m_p++;
+            stack>>= 1;
+            depth--;
+            ok= true;
+            break;
+          }
+          if(stack&1){                      // an object member starts with its key
+            if(*m_p!='"' || !skipString())
+              return false;
+            skipSpace();
+            if(*m_p++!=':')
+              return false;
+            skipSpace();
+          }
+          continue;                         // now the first value
+        default:  ok= skipNumber();
+      }
+      if(!ok)
+        return false;
+
+      //after a value: done, next element, or close the level
+      while(true){
+        if(depth==0)
+          return true;
+        skipSpace();
+        if(*m_p==','){
+          m_p++;
+          skipSpace();
+          if(stack&1){
+            if(*m_p!='"' || !skipString())
+              return false;
+            skipSpace();
+            if(*m_p++!=':')
+              return false;
+            skipSpace();
+          }
+          break;                            // next value
+        }
+        if(*m_p!=(stack&1 ? '}' : ']'))
+          return false;
+        m_p++;
+        stack>>= 1;
+        depth--;
+      }
+    }
+  }
+
+
+  bool JsonReader::integer(int32_t &value) const {
+    if(m_type!=Number)
+      return false;
+    const char *p= m_value;
+    bool negative= (*p=='-');
+    if(negative)
+      p++;
+    int64_t v= 0;
+    for(; *p>='0' && *p<='9'; p++){
+      if(v<=0x80000000LL)
+        v= v*10+(*p-'0');
+    }
+    if(*p=='.')
+      for(p++; *p>='0' && *p<='9'; p++);
+    if(*p=='e' || *p=='E')                  // exponents are not worth the code
+      return false;
+    v= (negative ? -v : v);
+    value= (v>INT32_MAX ? INT32_MAX : (v<INT32_MIN ? INT32_MIN : (int32_t)v));
+    return true;
+  }
+
+
+  bool JsonReader::string(char *dst, size_t size) const {
+    if(m_type!=String || size==0)
+      return false;
+    size_t n= 0;
+    for(const char *p=m_value+1; *p!='"'; p++){
+      uint32_t c= (uint8_t)*p;
+      if(c=='\\'){
+        c= *++p;
+        switch(c){
+          case 'b': c='\b'; break;
+          case 'f': c='\f'; break;
+          case 'n': c='\n'; break;
+          case 'r': c='\r'; break;
+          case 't': c='\t'; break;
+          case 'u':
+            c= (hex(p[1])<<12)|(hex(p[2])<<8)|(hex(p[3])<<4)|hex(p[4]);
+            p+= 4;
+            //surrogate pair
+            if(c>=0xd800 && c<0xdc00 && p[1]=='\\' && p[2]=='u'){
+              uint32_t low= (hex(p[3])<<12)|(hex(p[4])<<8)|(hex(p[5])<<4)|hex(p[6]);
+              if(low>=0xdc00 && low<0xe000){
+                c= 0x10000+((c-0xd800)<<10)+(low-0xdc00);
+                p+= 6;
+              }
+            }
+            break;
+        }
+        if(c>=0x80){                        // encode as UTF-8
+          uint8_t utf[4];
+          size_t len;
+          if(c<0x800){
+            utf[0]= 0xc0|(c>>6); utf[1]= 0x80|(c&0x3f); len= 2;
+          } else if(c<0x10000){
+            utf[0]= 0xe0|(c>>12); utf[1]= 0x80|((c>>6)&0x3f); utf[2]= 0x80|(c&0x3f); len= 3;
+          } else {
+            utf[0]= 0xf0|(c>>18); utf[1]= 0x80|((c>>12)&0x3f); utf[2]= 0x80|((c>>6)&0x3f); utf[3]= 0x80|(c&0x3f); len= 4;
+          }
+          for(size_t i=0; i<len && n<size-1; i++)
+            dst[n++]= utf[i];
+          continue;
+        }
+      }
+      if(n<size-1)
+        dst[n++]= c;
+    }
+    dst[n]= 0x0;
+    return true;
+  }
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef LEDBLINKER_H
+  #define LEDBLINKER_H
+
+  #include <Arduino.h>
+
+  //steps per pattern, 0 terminated
+  #define LEDBLINKER_STEPS 8
+
+  //LED patterns played back by the timer1 interrupt
+  //the interrupt only fires when the LED has to change, so a pattern costs a
+  //few interrupts per second and keeps going while the main loop is blocked,
+  //e.g. during an OTA update. the LED is set with GPOS/GPOC, so it has to be
+  //on GPIO0...15. timer1 is also used by analogWrite() and tone(), which this
+  //program doesn't use
+  class LedBlinker {
+
+  public:
+    enum Pattern {Off, Single, Double, Tripple, On};
+
+    //onLevel: the pin level that lights the LED
+    LedBlinker(uint8_t pin, uint8_t onLevel){
+      s_mask= (1<<pin);
+      s_onLevel= onLevel;
+      m_pin= pin;
+    }
+
+    //set up the pin and the timer, LED off
+    void begin();
+
+    //switch to a pattern, a pattern that is already playing keeps its phase
+    void play(Pattern pattern);
+
+    Pattern pattern() const { return s_pattern; }
+
+  protected:
+    static void IRAM_ATTR led(bool on){
+      if(on==(s_onLevel!=0))
+        GPOS= s_mask;
+      else
+        GPOC= s_mask;
+    }
+
+    //ms to timer1 ticks at 80MHz/256, its 23 bits last for 26s
+    static uint32_t IRAM_ATTR ticks(uint16_t ms){ return ((uint32_t)ms*625)/2; }
+
+    static void IRAM_ATTR next();
+
+    uint8_t m_pin;
+    static uint32_t s_mask;
+    static uint8_t s_onLevel;
+    static volatile Pattern s_pattern;
+    static volatile uint8_t s_step;
+    static const uint16_t s_patterns[On+1][LEDBLINKER_STEPS];
+  };
+
+  uint32_t LedBlinker::s_mask= 0;
+  uint8_t LedBlinker::s_onLevel= HIGH;
+  volatile LedBlinker::Pattern LedBlinker::s_pattern= LedBlinker::Off;
+  volatile uint8_t LedBlinker::s_step= 0;
+
+  //durations in ms, alternating on and off starting with on, 0 ends a cycle
+  //no step at all is off, a single on time is steady on
+  const uint16_t LedBlinker::s_patterns[LedBlinker::On+1][LEDBLINKER_STEPS]= {
+    {0},                                  // Off
+    {10, 1490, 0},                        // Single
+    {10, 180, 10, 1500, 0},               // Double
+    {10, 190, 10, 190, 10, 1490, 0},      // Tripple
+    {1, 0}                                // On
+  };
+
+
+
+  void LedBlinker::begin(){
+    pinMode(m_pin, OUTPUT);
+    led(false);
+    timer1_disable();
+    timer1_isr_init();
+    timer1_attachInterrupt(next);
+  }
+
+
+  void LedBlinker::play(Pattern pattern){
+    if(pattern==s_pattern)
+      return;
+
+    timer1_disable();
+    s_pattern= pattern;
+    s_step= 0;
+    const uint16_t *steps= s_patterns[pattern];
+    led(steps[0]!=0);
+    if(steps[0]==0 || steps[1]==0)
+      return;                       // steady, no timer needed
+    timer1_enable(TIM_DIV256, TIM_EDGE, TIM_SINGLE);
+    timer1_write(ticks(steps[0]));
+  }
+
+
+  //timer1 interrupt: on to the next step of the pattern
+  void IRAM_ATTR LedBlinker::next(){
+    const uint16_t *steps= s_patterns[s_pattern];
+    uint8_t step= s_step+1;
+    if(step>=LEDBLINKER_STEPS || steps[step]==0)
+      step= 0;
+    s_step= step;
+    led(!(step&1));
+    timer1_write(ticks(steps[step]));
+  }
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef POWERPOLICY_H
+  #define POWERPOLICY_H
+
+  #include <Arduino.h>
+  #include <ESP8266WiFi.h>
+
+  //ms without traffic before a session counts as idle
+  #ifndef POWER_IDLE_TIME
+    #define POWER_IDLE_TIME 2000
+  #endif
+
+  //WiFi sleep mode following the traffic of the bridge
+  //while bytes are moving the radio stays on (no sleep, lowest latency), once
+  //a session was idle for POWER_IDLE_TIME it drops to the configured sleep
+  //mode. without a session it uses modem sleep, the automatic light sleep
+  //would cost the AT commands coming in on the serial line.
+  //the time spent in each mode is accounted for, to weigh latency against battery
+  class PowerPolicy {
+
+  public:
+    //what an idle session may do, the values of the psave configuration item
+    enum Level {Off, Modem, Light};
+
+    PowerPolicy(){
+      m_level=Modem;
+      m_mode=WIFI_MODEM_SLEEP;
+      m_bytes=0;
+      m_lastActive=0;
+      m_last=0;
+      m_switches=0;
+      for(uint8_t n=0; n<3; n++)
+        m_time[n]=0;
+    }
+
+    //sleep mode for idle sessions, Off leaves the SDK default alone
+    void level(uint8_t level);
+
+    //call every pass with the running total of bridged bytes
+    void poll(bool connected, uint32_t bytes, uint32_t now);
+
+    //true while a session is moving data
+    bool active() const { return m_mode==WIFI_NONE_SLEEP; }
+
+    //accumulated ms spent in a sleep mode
+    uint32_t time(WiFiSleepType_t mode) const { return (mode<=WIFI_MODEM_SLEEP ? m_time[mode] : 0); }
+
+    //number of mode changes
+    uint32_t switches() const { return m_switches; }
+
+  protected:
+    void select(WiFiSleepType_t mode);
+
+    uint8_t m_level;
+    WiFiSleepType_t m_mode;
+    uint32_t m_bytes;
+    uint32_t m_lastActive;
+    uint32_t m_last;
+    uint32_t m_switches;
+    uint32_t m_time[3];     // indexed by WiFiSleepType_t: none, light, modem
+  };
+
+
+
+  void PowerPolicy::level(uint8_t level){
+    m_level= level;
+    if(m_level==Off)
+      select(WIFI_MODEM_SLEEP);   // the SDK default for a station
+  }
+
+
+  void PowerPolicy::select(WiFiSleepType_t mode){
+    if(mode==m_mode)
+      return;
+    WiFi.setSleepMode(mode);
+    m_mode= mode;
+    m_switches++;
+  }
+
+
+  void PowerPolicy::poll(bool connected, uint32_t bytes, uint32_t now){
+    m_time[m_mode]+= now-m_last;
+    m_last= now;
+
+    if(bytes!=m_bytes){
+      m_bytes= bytes;
+      m_lastActive= now;
+    }
+    if(m_level==Off)
+      return;
+
+    if(!connected)
+      select(WIFI_MODEM_SLEEP);
+    else if((now-m_lastActive)<POWER_IDLE_TIME)
+      select(WIFI_NONE_SLEEP);
+    else
+      select(m_level==Light ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+  }
+
+#endif
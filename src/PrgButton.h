@@ -0,0 +1,93 @@
+#ifndef PRGBUTTON_H
+  #define PRGBUTTON_H
+
+  #include <Arduino.h>
+
+  //ms of contact bounce, presses shorter than this are ignored
+  #ifndef BUTTON_DEBOUNCE
+    #define BUTTON_DEBOUNCE 30
+  #endif
+
+  //push button to GND, read by an edge interrupt
+  //the interrupt follows the pin on every edge and posts an event once the
+  //button is released, the main loop picks the events up with events(). a
+  //press that follows a release within BUTTON_DEBOUNCE ms is contact bounce
+  //and continues the press before, so each press posts one event only.
+  //presses are caught while the main loop is blocked, durations are wrap safe
+  class PrgButton {
+
+  public:
+    //what a press was, as bits
+    enum Event {None=0, Short=1, Long=2};
+
+    //longPress: ms a press has to last to count as long
+    PrgButton(uint8_t pin, uint32_t longPress){
+      m_pin= pin;
+      m_longPress= longPress;
+      m_pressed= false;
+      m_posted= true;
+      m_start= 0;
+      m_released= 0;
+      m_events= None;
+    }
+
+    //set up the pin and attach the interrupt
+    void begin();
+
+    //takes the events posted since the last call
+    uint8_t events(){
+      if(!m_events)
+        return None;
+      noInterrupts();
+      uint8_t events= m_events;
+      m_events= None;
+      interrupts();
+      return events;
+    }
+
+  protected:
+    static void IRAM_ATTR edge(void *arg);
+
+    uint8_t m_pin;
+    uint32_t m_longPress;
+    volatile bool m_pressed;
+    volatile bool m_posted;         // the current press posted its event
+    volatile uint32_t m_start;      // millis() the press started
+    volatile uint32_t m_released;   // millis() of the last release
+    volatile uint8_t m_events;
+  };
+
+
+
+  void PrgButton::begin(){
+    pinMode(m_pin, INPUT);
+    m_pressed= (digitalRead(m_pin)==LOW);   // held at boot: no event for that press
+    m_released= millis()-BUTTON_DEBOUNCE;
+    attachInterruptArg(digitalPinToInterrupt(m_pin), edge, this, CHANGE);
+  }
+
+
+  void IRAM_ATTR PrgButton::edge(void *arg){
+    PrgButton *b= (PrgButton*)arg;
+    uint32_t now= millis();
+    bool pressed= (digitalRead(b->m_pin)==LOW);
+    if(pressed==b->m_pressed)
+      return;
+    b->m_pressed= pressed;
+
+    if(pressed){
+      if((now-b->m_released)>=BUTTON_DEBOUNCE){   // a new press, not bounce of the last release
+        b->m_start= now;
+        b->m_posted= false;
+      }
+    } else {
+      b->m_released= now;
+      uint32_t held= now-b->m_start;
+      if(!b->m_posted && held>=BUTTON_DEBOUNCE){
+        b->m_events|= (held>=b->m_longPress ? Long : Short);
+        b->m_posted= true;
+      }
+    }
+  }
+
+#endif
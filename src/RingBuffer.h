@@ -0,0 +1,96 @@
+#ifndef RINGBUFFER_H
+  #define RINGBUFFER_H
+
+  #include <Arduino.h>
+
+  // lock-free single-producer/single-consumer byte ring
+  // head is only ever written by the producer, tail only by the consumer.
+  // both are free running counters, so size() stays correct across wrap-around
+  template <size_t N>
+  class RingBuffer {
+    static_assert(N>0 && (N & (N-1))==0, "RingBuffer capacity must be a power of two");
+
+  public:
+    RingBuffer():m_head(0),m_tail(0){}
+
+    size_t capacity() const { return N; }
+    size_t size() const { return m_head-m_tail; }
+    size_t space() const { return N-size(); }
+    bool empty() const { return m_head==m_tail; }
+
+    //consumer side: drop everything currently queued
+    void clear(){ m_tail= m_head; }
+
+    //producer side: contiguous free region, to be filled and then commit()ed
+    size_t reserve(uint8_t **data){
+      size_t pos= m_head&(N-1);
+      size_t len= N-pos;
+      *data= m_buf+pos;
+      return (len<space() ? len : space());
+    }
+
+    void commit(size_t len){ m_head= m_head+len; }
+
+    //consumer side: contiguous readable region, to be used and then consume()d
+    size_t peek(const uint8_t **data) const {
+      size_t pos= m_tail&(N-1);
+      size_t len= N-pos;
+      *data= m_buf+pos;
+      return (len<size() ? len : size());
+    }
+
+    void consume(size_t len){ m_tail= m_tail+len; }
+
+    //several consumers: each reads from its own free running position between
+    //tail() and head(), the slowest one consume()s
+    size_t head() const { return m_head; }
+    size_t tail() const { return m_tail; }
+
+    //contiguous readable region starting at such a position
+    size_t peekAt(size_t pos, const uint8_t **data) const {
+      size_t off= pos&(N-1);
+      size_t len= N-off;
+      size_t avail= m_head-pos;
+      *data= m_buf+off;
+      return (len<avail ? len : avail);
+    }
+
+    //copy in as much as fits, returns number of bytes queued
+    size_t push(const uint8_t *data, size_t len){
+      size_t done= 0;
+      while(done<len){
+        uint8_t *dst;
+        size_t n= reserve(&dst);
+        if(n==0)
+          break;
+        n= (n<(len-done) ? n : len-done);
+        memcpy(dst, data+done, n);
+        commit(n);
+        done+= n;
+      }
+      return done;
+    }
+
+    //copy out up to len bytes, returns number of bytes taken
+    size_t pop(uint8_t *data, size_t len){
+      size_t done= 0;
+      while(done<len){
+        const uint8_t *src;
+        size_t n= peek(&src);
+        if(n==0)
+          break;
+        n= (n<(len-done) ? n : len-done);
+        memcpy(data+done, src, n);
+        consume(n);
+        done+= n;
+      }
+      return done;
+    }
+
+  protected:
+    uint8_t m_buf[N];
+    volatile size_t m_head;
+    volatile size_t m_tail;
+  };
+
+#endif
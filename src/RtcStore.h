@@ -0,0 +1,60 @@
+#ifndef RTCSTORE_H
+  #define RTCSTORE_H
+
+  #include <Arduino.h>
+  #include "config.h"
+
+  //RTC user memory survives deep sleep (but not a power cycle) and costs no
+  //flash writes, which makes it the place for state that only has to bridge
+  //one sleep. it is 128 blocks of 4 bytes, the first ones are used by eboot
+  //to hand over an OTA update, so we stay clear of them
+  #ifndef RTCSTORE_BASE
+    #define RTCSTORE_BASE 64
+  #endif
+  #define RTCSTORE_SLOT_BLOCKS 16                     // 64 bytes per slot, crc included
+
+  //one slot per user, in blocks from the start of RTC user memory
+  enum RtcSlot {
+    RtcWiFi=  RTCSTORE_BASE,                          // last good access point and lease
+    RtcSleep= RtcWiFi+RTCSTORE_SLOT_BLOCKS,           // learned sleep timeout
+    RtcDns=   RtcSleep+RTCSTORE_SLOT_BLOCKS,          // address of the remote server
+    RtcEnd=   RtcDns+RTCSTORE_SLOT_BLOCKS
+  };
+  static_assert(RtcEnd<=128, "RtcStore: slots exceed RTC user memory");
+
+  //the content of a slot and its checksum, random memory after a power cycle fails the check
+  template <class T>
+  struct RtcRecord {
+    T data;
+    uint32_t crc;
+  };
+
+  //reads a slot, returns false if it holds no valid T
+  template <class T>
+  bool rtcLoad(RtcSlot slot, T &data){
+    static_assert(sizeof(RtcRecord<T>)<=RTCSTORE_SLOT_BLOCKS*4, "RtcStore: record too large for a slot");
+    RtcRecord<T> rec;
+    if(!ESP.rtcUserMemoryRead(slot, (uint32_t*)&rec, sizeof(rec)) ||
+       rec.crc!=crc32((const uint8_t*)&rec.data, sizeof(T)))
+      return false;
+    memcpy(&data, &rec.data, sizeof(T));
+    return true;
+  }
+
+  //writes a slot
+  template <class T>
+  bool rtcSave(RtcSlot slot, const T &data){
+    static_assert(sizeof(RtcRecord<T>)<=RTCSTORE_SLOT_BLOCKS*4, "RtcStore: record too large for a slot");
+    RtcRecord<T> rec;
+    memcpy(&rec.data, &data, sizeof(T));
+    rec.crc= crc32((const uint8_t*)&rec.data, sizeof(T));
+    return ESP.rtcUserMemoryWrite(slot, (uint32_t*)&rec, sizeof(rec));
+  }
+
+  //invalidates a slot
+  inline void rtcClear(RtcSlot slot){
+    uint32_t zero[RTCSTORE_SLOT_BLOCKS]= {0};
+    ESP.rtcUserMemoryWrite(slot, zero, sizeof(zero));
+  }
+
+#endif
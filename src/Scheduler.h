@@ -0,0 +1,229 @@
+#ifndef SCHEDULER_H
+  #define SCHEDULER_H
+
+  #include <Arduino.h>
+  #include <coredecls.h>
+
+  //resolution of the timer wheel in ms
+  #ifndef SCHEDULER_TICK
+    #define SCHEDULER_TICK 10
+  #endif
+
+  //buckets of the timer wheel, timers further out than SCHEDULER_SLOTS ticks
+  //simply stay in their bucket for another round
+  #ifndef SCHEDULER_SLOTS
+    #define SCHEDULER_SLOTS 32
+  #endif
+
+  class Scheduler;
+
+  //a one-shot or periodic callback run by the Scheduler from the main loop
+  class Timer {
+    friend class Scheduler;
+
+  public:
+    typedef void (*Callback)();
+
+    //period 0 makes it a one-shot timer
+    Timer(Scheduler &scheduler, Callback callback, uint32_t period=0):m_scheduler(scheduler){
+      m_callback= callback;
+      m_period= period;
+      m_deadline= 0;
+      m_armed= false;
+      m_due= false;
+      m_slot= 0;
+      m_next= NULL;
+      m_prev= NULL;
+      m_nextDue= NULL;
+    }
+
+    //(re)arm to fire after delay ms, periodic timers then keep going every period
+    void start(uint32_t delay);
+
+    //(re)arm to fire after one period
+    void start(){ start(m_period); }
+
+    void stop();
+
+    //change the period, takes effect the next time the timer is armed
+    void interval(uint32_t period){ m_period= period; }
+
+    bool armed() const { return m_armed || m_due; }
+
+  protected:
+    Scheduler &m_scheduler;
+    Callback m_callback;
+    uint32_t m_period;
+    uint32_t m_deadline;    // millis() when due
+    bool m_armed;
+    bool m_due;             // taken out of its bucket to be run, not run yet
+    uint8_t m_slot;         // bucket it is linked into
+    Timer *m_next;          // list of the bucket
+    Timer *m_prev;
+    Timer *m_nextDue;       // list of the timers due in the tick being run
+  };
+
+
+  //cooperative scheduler: a hashed timer wheel for the housekeeping, and an
+  //idle wait that ends as soon as there is I/O to do
+  //timers are kept in SCHEDULER_SLOTS buckets by their due tick, so arming,
+  //stopping and running them costs the same no matter how many there are
+  class Scheduler {
+    friend class Timer;
+    static_assert(SCHEDULER_SLOTS<=256 && (SCHEDULER_SLOTS&(SCHEDULER_SLOTS-1))==0, "Scheduler: slots must be a power of two up to 256");
+
+  public:
+    //tells idle() whether there is I/O waiting
+    typedef bool (*Ready)();
+
+    Scheduler(){
+      m_tick= 0;
+      m_tickend= millis()+SCHEDULER_TICK-1;
+      for(size_t n=0; n<SCHEDULER_SLOTS; n++)
+        m_wheel[n]= NULL;
+    }
+
+    //run every timer that is due
+    void run();
+
+    //ms until the next timer is due, limit if none is due earlier
+    uint32_t nextDue(uint32_t limit) const;
+
+    //wait up to limit ms or until the next timer is due, but return as soon
+    //as ready() reports I/O, which is checked every ms. doesn't wait at all
+    //while I/O is pending
+    void idle(uint32_t limit, Ready ready);
+
+  protected:
+    void link(Timer *t);
+    void unlink(Timer *t);
+
+    Timer *m_wheel[SCHEDULER_SLOTS];
+    uint32_t m_tick;        // next tick to be processed, free running
+    uint32_t m_tickend;     // last ms of that tick, it is processed once millis() got there
+  };
+
+
+
+  void Timer::start(uint32_t delay){
+    stop();
+    m_deadline= millis()+delay;
+    m_scheduler.link(this);
+  }
+
+
+  void Timer::stop(){
+    m_due= false;
+    if(m_armed)
+      m_scheduler.unlink(this);
+  }
+
+
+  void Scheduler::link(Timer *t){
+    //ticks ahead of the next one to be processed, a deadline in the past goes into that one
+    int32_t ahead= t->m_deadline-(m_tickend-(SCHEDULER_TICK-1));
+    uint32_t tick= m_tick+(ahead>0 ? ahead/SCHEDULER_TICK : 0);
+    t->m_slot= tick&(SCHEDULER_SLOTS-1);
+    Timer *&head= m_wheel[t->m_slot];
+    t->m_prev= NULL;
+    t->m_next= head;
+    if(head)
+      head->m_prev= t;
+    head= t;
+    t->m_armed= true;
+  }
+
+
+  void Scheduler::unlink(Timer *t){
+    if(t->m_prev)
+      t->m_prev->m_next= t->m_next;
+    else
+      m_wheel[t->m_slot]= t->m_next;
+    if(t->m_next)
+      t->m_next->m_prev= t->m_prev;
+    t->m_next= NULL;
+    t->m_prev= NULL;
+    t->m_armed= false;
+  }
+
+
+  void Scheduler::run(){
+    uint32_t now= millis();
+    if((int32_t)(now-m_tickend)<0)
+      return;
+
+    //after a long stall every bucket is looked at once
+    uint32_t steps= (now-m_tickend)/SCHEDULER_TICK+1;
+    if(steps>SCHEDULER_SLOTS){
+      m_tick+= steps-SCHEDULER_SLOTS;
+      m_tickend+= (steps-SCHEDULER_SLOTS)*SCHEDULER_TICK;
+      steps= SCHEDULER_SLOTS;
+    }
+
+    for(; steps>0; steps--){
+      Timer *t= m_wheel[m_tick&(SCHEDULER_SLOTS-1)];
+      //move on first, so timers armed from here on go into later buckets
+      m_tick++;
+      m_tickend+= SCHEDULER_TICK;
+
+      //take the due timers out before running them, the callbacks may arm and stop timers.
+      //one that is stopped or armed again before its turn isn't due any more
+      Timer *due= NULL;
+      while(t){
+        Timer *next= t->m_next;
+        if((int32_t)(now-t->m_deadline)>=0){
+          unlink(t);
+          t->m_due= true;
+          t->m_nextDue= due;
+          due= t;
+        }
+        t= next;
+      }
+
+      while(due){
+        t= due;
+        due= t->m_nextDue;
+        t->m_nextDue= NULL;
+        if(!t->m_due)
+          continue;
+        t->m_due= false;
+        if(t->m_period){        // re-armed before the callback, which may stop it
+          t->m_deadline+= t->m_period;
+          if((int32_t)(now-t->m_deadline)>=0)   // fell behind, don't try to catch up
+            t->m_deadline= now+t->m_period;
+          link(t);
+        }
+        t->m_callback();
+      }
+    }
+  }
+
+
+  uint32_t Scheduler::nextDue(uint32_t limit) const {
+    uint32_t now= millis();
+    for(size_t n=0; n<SCHEDULER_SLOTS; n++){
+      for(Timer *t=m_wheel[n]; t; t=t->m_next){
+        //a timer runs at the end of its tick
+        int32_t ahead= t->m_deadline-m_tickend;
+        uint32_t due= m_tickend+(ahead>0 ? ((ahead+SCHEDULER_TICK-1)/SCHEDULER_TICK)*SCHEDULER_TICK : 0);
+        int32_t left= due-now;
+        if(left<=0)
+          return 0;
+        if((uint32_t)left<limit)
+          limit= left;
+      }
+    }
+    return limit;
+  }
+
+
+  void Scheduler::idle(uint32_t limit, Ready ready){
+    if(ready())
+      return;
+    uint32_t wait= nextDue(limit);
+    if(wait==0)
+      return;
+    esp_delay(wait, [ready](){ return !ready(); }, 1);
+  }
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SERIALPACER_H
+  #define SERIALPACER_H
+
+  #include <Arduino.h>
+
+  //CPU time a single bridge pass may spend bit-banging bytes onto the serial line
+  #ifndef SERIAL_TX_SLICE_US
+    #define SERIAL_TX_SLICE_US 2000
+  #endif
+
+  //bits on the wire per character (8N1)
+  #define SERIAL_BITS_PER_CHAR 10
+
+  //paces output to the (software) serial port
+  //SoftwareSerial::write() blocks for the whole transmission, so instead of
+  //handing it a complete chunk we only ever give it as many bytes as fit
+  //into SERIAL_TX_SLICE_US and leave the rest queued for the next pass
+  class SerialPacer {
+
+  public:
+    SerialPacer(Stream &serial):m_serial(serial){
+      baudrate(9600);
+      m_busy=0;
+    }
+
+    //recalculate character time after the line speed changed
+    void baudrate(uint32_t baud){
+      m_chartime= (1000000UL*SERIAL_BITS_PER_CHAR)/(baud ? baud : 1);
+    }
+
+    //time needed to send one character in us
+    uint32_t charTime() const { return m_chartime; }
+
+    //number of bytes that may be sent in this pass, at least one
+    size_t budget() const {
+      size_t n= SERIAL_TX_SLICE_US/m_chartime;
+      return (n ? n : 1);
+    }
+
+    //time needed to send the given number of bytes in ms
+    uint32_t drainTime(size_t pending) const {
+      return (uint32_t)(((uint64_t)pending*m_chartime)/1000);
+    }
+
+    //accumulated time spent transmitting in us
+    uint32_t busyTime() const { return m_busy; }
+
+    //send up to budget() bytes, returns the number of bytes sent
+    size_t write(const uint8_t *buffer, size_t size);
+
+  protected:
+    Stream &m_serial;
+    uint32_t m_chartime;
+    uint32_t m_busy;
+  };
+
+
+
+  size_t SerialPacer::write(const uint8_t *buffer, size_t size){
+    size_t n= budget();
+    size= (size>n ? n : size);
+    if(size==0)
+      return 0;
+
+    uint32_t start= micros();
+    size= m_serial.write(buffer, size);
+    m_busy+= micros()-start;
+    return size;
+  }
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef SESSIONS_H
+  #define SESSIONS_H
+
+  #include <Arduino.h>
+  #include <ESP8266WiFi.h>
+
+  //number of read-only clients next to the writer
+  #ifndef SESSION_MONITORS
+    #define SESSION_MONITORS 3
+  #endif
+
+  //TCP keepalive of every client: s between probes and the number of unanswered
+  //probes until the connection is dropped, the idle time before is configured
+  #ifndef SESSION_KEEPALIVE_INTERVAL
+    #define SESSION_KEEPALIVE_INTERVAL 2
+  #endif
+  #ifndef SESSION_KEEPALIVE_COUNT
+    #define SESSION_KEEPALIVE_COUNT 3
+  #endif
+
+  //the network side of the bridge: one writer and up to SESSION_MONITORS monitors
+  //the writer holds the write token, it talks to the G850 and gets its answers
+  //and the AT command replies. monitors only watch what the G850 sends, anything
+  //they send is dropped. the first client that connects while there is no writer
+  //becomes the writer, the others become monitors.
+  //all of them read straight from the bridge's serial->network ring, each at its
+  //own position, so the payload is never copied per client. every client only
+  //gets what its TCP send buffer takes without blocking, the rest stays in the
+  //ring and is retried on the next pass. the writer holds data in the ring as
+  //long as it needs, like the single client always did, a monitor that falls
+  //behind by more than the ring can hold skips ahead and loses those bytes.
+  //stale connections are reclaimed two ways: TCP keepalive drops clients that
+  //went away without a FIN within seconds, and if configured, a new client
+  //takes the write token over from a writer that was idle for the takeover time.
+  //by default a live writer is never taken over, so monitors can connect at
+  //any time
+  class Sessions {
+
+  public:
+    enum Event {None, WriterStart, WriterEnd, Takeover, MonitorStart, MonitorEnd, Rejected};
+
+    //writer: the client the bridge and the AT scanner of the network side talk to
+    Sessions(WiFiServer &server, WiFiClient &writer):m_server(server),m_writer(writer){
+      m_hasWriter= false;
+      m_writerPos= 0;
+      m_release= 0;
+      m_takeover= -1;
+      m_lastActive= 0;
+      m_lagged= 0;
+      m_rejected= 0;
+      m_takeovers= 0;
+      m_deferred= 0;
+      m_partial= 0;
+      m_nodelay= true;
+      m_keepalive= 0;
+      for(uint8_t n=0; n<SESSION_MONITORS; n++){
+        m_used[n]= false;
+        m_pos[n]= 0;
+      }
+    }
+
+    //s the writer has to be idle before a new client takes over, 0 right away, -1 never
+    void takeover(int32_t seconds){ m_takeover= seconds; }
+
+    //socket options: Nagle off, s of silence before keepalive probes (0 off),
+    //for new and connected clients
+    void options(bool nodelay, uint16_t keepalive);
+
+    //drop clients that went away and take a waiting connection, one change per call.
+    //Takeover: the old writer was closed and the new client is the writer
+    Event poll(uint32_t now);
+
+    //take a connected client, e.g. one we dialed, like a waiting connection
+    Event adopt(WiFiClient &client, uint32_t now);
+
+    //traffic from or to the writer
+    void touch(uint32_t now){ m_lastActive= now; }
+
+    bool writer() const { return m_hasWriter; }
+    uint8_t monitors() const;
+
+    //anyone connected at all
+    bool any() const { return m_hasWriter || monitors()>0; }
+
+    //ring position the writer reads from next, the release mark without writer
+    size_t position() const { return (m_hasWriter ? m_writerPos : m_release); }
+
+    //let the writer start reading at pos, e.g. skip what an earlier client left behind
+    void seek(size_t pos){ m_writerPos= pos; }
+
+    //true once the writer got everything up to pos
+    bool delivered(size_t pos) const { return (!m_hasWriter || m_writerPos==pos); }
+
+    //send what was released (ring data up to release) to every client, then free
+    //the ring up to the slowest reader, keeping reserve bytes free for new data.
+    //hold: without writer keep the ring for the next one, only the oldest bytes
+    //that have to make room go. returns the number of bytes sent to the writer
+    template <class Ring>
+    size_t send(Ring &ring, size_t release, size_t reserve, bool hold=false);
+
+    //bytes monitors skipped because they were too slow
+    uint32_t lagged() const { return m_lagged; }
+
+    //connections turned away because every slot was taken
+    uint32_t rejected() const { return m_rejected; }
+
+    //writers that lost the token to a new client
+    uint32_t takeovers() const { return m_takeovers; }
+
+    //bytes that didn't go out in the pass they were released in for lack of
+    //TCP send buffer and waited in the ring, each byte counted once per client
+    uint32_t deferred() const { return m_deferred; }
+
+    //bytes the TCP stack refused although it reported room for them
+    uint32_t partial() const { return m_partial; }
+
+  protected:
+    //write what is between pos and release to a client, as far as its send
+    //buffer takes it. fresh: bytes before release that are new with this pass
+    template <class Ring>
+    size_t write(WiFiClient &client, Ring &ring, size_t &pos, size_t release, size_t fresh);
+
+    //apply the socket options to a client
+    void tune(WiFiClient &client);
+
+    WiFiServer &m_server;
+    WiFiClient &m_writer;
+    bool m_hasWriter;
+    size_t m_writerPos;                   // ring position, free running like the ring's counters
+    WiFiClient m_monitor[SESSION_MONITORS];
+    bool m_used[SESSION_MONITORS];
+    size_t m_pos[SESSION_MONITORS];
+    size_t m_release;                     // release mark of the last send(), where new clients start
+    int32_t m_takeover;
+    uint32_t m_lastActive;                // millis() of the writer's last traffic
+    uint32_t m_lagged;
+    uint32_t m_rejected;
+    uint32_t m_takeovers;
+    uint32_t m_deferred;
+    uint32_t m_partial;
+    bool m_nodelay;
+    uint16_t m_keepalive;
+  };
+
+
+
+  uint8_t Sessions::monitors() const {
+    uint8_t count= 0;
+    for(uint8_t n=0; n<SESSION_MONITORS; n++)
+      if(m_used[n])
+        count++;
+    return count;
+  }
+
+
+  Sessions::Event Sessions::poll(uint32_t now){
+    if(m_hasWriter && !m_writer.connected()){
+      m_writer.stop();
+      m_hasWriter= false;
+      return WriterEnd;
+    }
+
+    for(uint8_t n=0; n<SESSION_MONITORS; n++){
+      WiFiClient &m= m_monitor[n];
+      if(!m_used[n])
+        continue;
+      if(!m.connected()){
+        m.stop();
+        m= WiFiClient();
+        m_used[n]= false;
+        return MonitorEnd;
+      }
+      //read-only, whatever a monitor sends is dropped
+      uint8_t drop[32];
+      while(m.available()>0 && m.read(drop, sizeof(drop))>0)
+        ;
+    }
+
+    WiFiClient client= m_server.available();
+    if(!client)
+      return None;
+    return adopt(client, now);
+  }
+
+
+  Sessions::Event Sessions::adopt(WiFiClient &client, uint32_t now){
+    tune(client);
+
+    //a writer whose connection is gone is replaced in any case, a live one only
+    //if the takeover time allows it
+    Event event= WriterStart;
+    if(m_hasWriter && (!m_writer.connected() || m_takeover==0 ||
+       (m_takeover>0 && (now-m_lastActive)>=(uint32_t)m_takeover*1000))){
+      #ifdef DEBUG
+        Serial.println("Sessions: idle writer taken over");
+      #endif
+      m_writer.stop();
+      m_hasWriter= false;
+      m_takeovers++;
+      event= Takeover;
+    }
+    if(!m_hasWriter){
+      m_writer= client;
+      m_hasWriter= true;
+      m_writerPos= m_release;
+      m_lastActive= now;
+      return event;
+    }
+    for(uint8_t n=0; n<SESSION_MONITORS; n++){
+      if(!m_used[n]){
+        m_monitor[n]= client;
+        m_used[n]= true;
+        m_pos[n]= m_release;
+        return MonitorStart;
+      }
+    }
+    client.stop();
+    m_rejected++;
+    return Rejected;
+  }
+
+
+  void Sessions::tune(WiFiClient &client){
+    client.setNoDelay(m_nodelay);
+    if(m_keepalive)
+      client.keepAlive(m_keepalive, SESSION_KEEPALIVE_INTERVAL, SESSION_KEEPALIVE_COUNT);
+    else
+      client.disableKeepAlive();
+  }
+
+
+  void Sessions::options(bool nodelay, uint16_t keepalive){
+    m_nodelay= nodelay;
+    m_keepalive= keepalive;
+    if(m_hasWriter)
+      tune(m_writer);
+    for(uint8_t n=0; n<SESSION_MONITORS; n++)
+      if(m_used[n])
+        tune(m_monitor[n]);
+  }
+
+
+  template <class Ring>
+  size_t Sessions::write(WiFiClient &client, Ring &ring, size_t &pos, size_t release, size_t fresh){
+    if(release-pos>ring.size())     // skipped past the release mark
+      return 0;
+
+    //up to two pieces, the data may wrap around the end of the ring
+    size_t sent= 0;
+    while(pos!=release){
+      const uint8_t *src;
+      size_t size= ring.peekAt(pos, &src);
+      size_t due= release-pos;
+      size= (size>due ? due : size);
+
+      //never more than the send buffer takes, client.write() would block until it does
+      size_t room= client.availableForWrite();
+      size= (size>room ? room : size);
+      if(size==0)
+        break;
+
+      size_t done= client.write(src, size);
+      pos+= done;
+      sent+= done;
+      if(done<size){
+        m_partial+= size-done;
+        break;
+      }
+    }
+
+    //what didn't go stays in the ring for the next pass
+    size_t left= release-pos;
+    m_deferred+= (left<fresh ? left : fresh);
+    return sent;
+  }
+
+
+  template <class Ring>
+  size_t Sessions::send(Ring &ring, size_t release, size_t reserve, bool hold){
+    size_t fresh= release-m_release;
+    m_release= release;
+    size_t sent= 0;
+    if(m_hasWriter)
+      sent= write(m_writer, ring, m_writerPos, release, fresh);
+    if(sent)
+      m_lastActive= millis();
+
+    //what has to go so the next slice of serial data fits, monitors can't hold that
+    size_t tail= ring.tail();
+    size_t used= ring.size();
+    size_t must= (used+reserve>ring.capacity() ? used+reserve-ring.capacity() : 0);
+    //the writer holds what it didn't get, without writer everything released may go,
+    //unless it is held for the next writer
+    size_t keep= (m_hasWriter || !hold ? position()-tail : must);
+
+    for(uint8_t n=0; n<SESSION_MONITORS; n++){
+      if(!m_used[n])
+        continue;
+      write(m_monitor[n], ring, m_pos[n], release, fresh);
+      size_t ahead= m_pos[n]-tail;
+      if(ahead<must){
+        m_lagged+= must-ahead;
+        m_pos[n]= tail+must;
+        ahead= must;
+      }
+      keep= (ahead<keep ? ahead : keep);
+    }
+
+    ring.consume(keep);
+    return sent;
+  }
+
+#endif
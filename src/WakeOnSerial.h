@@ -0,0 +1,90 @@
+#ifndef WAKEONSERIAL_H
+  #define WAKEONSERIAL_H
+
+  #include <Arduino.h>
+  #include <SoftwareSerial.h>
+  #include <coredecls.h>
+  extern "C" {
+    #include <user_interface.h>
+    #include <gpio.h>
+  }
+
+  //longest single forced light sleep in ms, the SDK takes up to 0xFFFFFFE us
+  #ifndef WAKEONSERIAL_SLICE
+    #define WAKEONSERIAL_SLICE 250000UL
+  #endif
+
+  //forced light sleep that ends when the G850 starts talking
+  //the CPU stops and only a level on the RX pin or the timer wakes it up
+  //again, within a few ms and with RAM, the serial buffers and the program
+  //state intact. the SDK only wakes on a level, so it is the start bit of the
+  //first character (HIGH with inverse logic) that does it. that character and
+  //the ones during the wake up are lost, what comes after is received.
+  //catching them isn't possible: the CPU only runs again a few ms after the
+  //start bit, at 9600 baud a character takes about 1 ms, so the bits are gone
+  //before any code could sample RX or re-sync SoftwareSerial. the G850 side
+  //has to send something the host can do without first, e.g. a CR.
+  //WiFi has to be off before sleep() is called
+  class WakeOnSerial {
+
+  public:
+    WakeOnSerial(SoftwareSerial &serial, uint8_t pin, bool inverse):m_serial(serial){
+      m_pin= pin;
+      m_level= (inverse ? GPIO_PIN_INTR_HILEVEL : GPIO_PIN_INTR_LOLEVEL);
+    }
+
+    //sleep for up to ms, returns true if the serial line woke us up, false if the
+    //time ran out. a wake up only counts if a character arrives within grace ms
+    bool sleep(uint32_t ms, uint32_t grace);
+
+  protected:
+    //called by the SDK after any wake up, lets the delay in sleep() return
+    static void wakeup(){
+      s_woken= true;
+      esp_schedule();
+    }
+
+    SoftwareSerial &m_serial;
+    uint8_t m_pin;
+    GPIO_INT_TYPE m_level;
+    static volatile bool s_woken;
+  };
+
+  volatile bool WakeOnSerial::s_woken= false;
+
+
+
+  bool WakeOnSerial::sleep(uint32_t ms, uint32_t grace){
+    //the wake up level replaces the pin's edge interrupt, SoftwareSerial gets it back afterwards
+    m_serial.enableRx(false);
+
+    //the clock stands still while sleeping, so the time is counted in whole slices
+    while(ms>0){
+      uint32_t slice= (ms>WAKEONSERIAL_SLICE ? WAKEONSERIAL_SLICE : ms);
+      s_woken= false;
+      wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+      wifi_fpm_open();
+      gpio_pin_wakeup_enable(GPIO_ID_PIN(m_pin), m_level);
+      wifi_fpm_set_wakeup_cb(wakeup);
+      wifi_fpm_do_sleep(slice*1000);
+      esp_delay(slice+1, [](){ return !s_woken; });    // the SDK enters the sleep while we wait
+      gpio_pin_wakeup_disable();
+      wifi_fpm_close();
+
+      //timer and serial wake ups look the same, only the serial one brings characters
+      m_serial.enableRx(true);
+      uint32_t start= millis();
+      while((millis()-start)<grace){
+        if(m_serial.available()>0)
+          return true;
+        delay(1);
+      }
+      m_serial.enableRx(false);
+      ms-= slice;
+    }
+
+    m_serial.enableRx(true);
+    return false;
+  }
+
+#endif
@@ -21,6 +21,9 @@
 
 #include <ArduinoJson.h>
 #include <LittleFS.h>
+#include <EEPROM.h>
+#include <IPAddress.h>
+#include "JsonReader.h"
 
 
 #define SERIALBAUDRATE 9600
@@ -31,25 +34,6 @@
 #define SOFTBAUDRATE4 9600
 
 
-
-// Our configuration structure.
-//
-// Never use a JsonDocument to store the configuration!
-// A JsonDocument is *not* a permanent storage; it's only a temporary storage
-// used during the serialization phase. See:
-// https://arduinojson.org/v6/faq/why-must-i-create-a-separate-config-object/
-struct Config {
-    int revision;
-    char wifissid[33];
-    char wifipassword[64];
-    char hostname[255];  
-    char otapw[64];
-    int sleeptimeout;
-    int softbaudrate;
-    int rawport;
-};
-#define JSONSIZE 512
-
 #define REVISION_TAG "rev"
 #ifndef REVISION 
   #define REVISION 1 
@@ -89,110 +73,458 @@ struct Config {
 #define MINIMUMSLEEPTIMEOUT 30
 #endif
 
+#define ADAPTSLEEP_TAG "adapt"
+#ifndef ADAPTSLEEP
+#define ADAPTSLEEP 0        // 1 learns the sleep timeout from the sessions, starting at sleep
+#endif
+
+#define SLEEPMIN_TAG "sleepmin"
+#ifndef SLEEPMIN
+#define SLEEPMIN 120        // bounds of the learned sleep timeout
+#endif
+
+#define SLEEPMAX_TAG "sleepmax"
+#ifndef SLEEPMAX
+#define SLEEPMAX 3600
+#endif
+
+#define DOZETIMEOUT_TAG "doze"
+#ifndef DOZETIMEOUT
+#define DOZETIMEOUT 0       // idle seconds before light sleep, 0 never dozes: WiFi is off then, no PC or OTA gets through
+#endif
+
 #define SOFTBAUDRATE_TAG "baud"
 #ifndef SOFTBAUDRATE
 #define SOFTBAUDRATE 9600
 #endif
 
+#define COALESCEGAP_TAG "gap"
+#ifndef COALESCEGAP
+#define COALESCEGAP 3       // idle gap in character times before serial data is sent to the network
+#endif
+
+#define COALESCECHUNK_TAG "chunk"
+#ifndef COALESCECHUNK
+#define COALESCECHUNK 256   // number of serial bytes that are sent to the network without waiting for a gap
+#endif
+
+#define GUARDTIME_TAG "guard"
+#ifndef GUARDTIME
+#define GUARDTIME 1000      // silence in ms needed before and after +++ to get into command mode
+#endif
+
+#ifndef MINIMUMGUARDTIME
+#define MINIMUMGUARDTIME 100
+#endif
+
+#define ONLINECOMMANDS_TAG "online"
+#ifndef ONLINECOMMANDS
+#define ONLINECOMMANDS 0    // 1 runs "+++AT..." sent without the guard time after +++ as a single command
+#endif
+
+#define POWERSAVE_TAG "psave"
+#ifndef POWERSAVE
+#define POWERSAVE 1         // radio sleep while a session is idle: 0 SDK default, 1 modem sleep, 2 light sleep
+#endif
+
+#define TAKEOVER_TAG "takeover"
+#ifndef TAKEOVER
+#define TAKEOVER -1         // idle seconds of the writer before a new client takes over, 0 always, -1 never
+#endif
+
+#define NODELAY_TAG "nodelay"
+#ifndef NODELAY
+#define NODELAY 1           // 1 sends short writes right away, 0 lets Nagle collect them
+#endif
+
+#define KEEPALIVE_TAG "keepalive"
+#ifndef KEEPALIVE
+#define KEEPALIVE 5         // idle seconds before TCP keepalive probes a client, 0 off
+#endif
+
+#define REMOTEPORT_TAG "rport"
+#ifndef REMOTEPORT
+#define REMOTEPORT 23       // port of the remote server
+#endif
+
+#ifndef MAXIMUMCOALESCECHUNK
+#define MAXIMUMCOALESCECHUNK 1024   // size of the bridge buffer
+#endif
+
+// remote server the adapter connects to when the G850 starts talking, empty: listen only
+#define REMOTEHOST_TAG "remote"
+#ifndef REMOTEHOST
+#define REMOTEHOST ""
+#endif
+
+// static network profile, an empty ip means DHCP
+#define STATICIP_TAG "ip"
+#ifndef STATICIP
+#define STATICIP ""
+#endif
+
+#define STATICGATEWAY_TAG "gw"
+#ifndef STATICGATEWAY
+#define STATICGATEWAY ""
+#endif
+
+#define STATICMASK_TAG "mask"
+#ifndef STATICMASK
+#define STATICMASK ""
+#endif
+
+#define STATICDNS_TAG "dns"
+#ifndef STATICDNS
+#define STATICDNS ""        // the gateway if empty
+#endif
+
+
+
+// The configuration schema: every item exactly once, with its JSON tag, default
+// and valid range or validator. The Config struct, the defaults, the JSON mapping, the
+// validation and the snapshot layout are all generated from this list, which is
+// also the order of the items in config.ini.
+//
+//     member          JSON tag             default         minimum                maximum
+//                                                          size                   validator
+#define CONFIG_ITEMS(INT, STR) \
+  INT( revision,      REVISION_TAG,        REVISION,       0,                     0x7fffffff ) \
+  INT( sleeptimeout,  SLEEPTIMEOUT_TAG,    SLEEPTIMEOUT,   MINIMUMSLEEPTIMEOUT,   0x7fffffff/1000 ) \
+  INT( adaptsleep,    ADAPTSLEEP_TAG,      ADAPTSLEEP,     0,                     1 ) \
+  INT( sleepmin,      SLEEPMIN_TAG,        SLEEPMIN,       MINIMUMSLEEPTIMEOUT,   0x7fffffff/1000 ) \
+  INT( sleepmax,      SLEEPMAX_TAG,        SLEEPMAX,       MINIMUMSLEEPTIMEOUT,   0x7fffffff/1000 ) \
+  INT( dozetimeout,   DOZETIMEOUT_TAG,     DOZETIMEOUT,    0,                     0x7fffffff/1000 ) \
+  INT( softbaudrate,  SOFTBAUDRATE_TAG,    SOFTBAUDRATE,   SOFTBAUDRATE0,         SOFTBAUDRATE4 ) \
+  INT( rawport,       RAW_TCP_PORT_TAG,    RAW_TCP_PORT,   1,                     65535 ) \
+  INT( coalescegap,   COALESCEGAP_TAG,     COALESCEGAP,    0,                     1000 ) \
+  INT( coalescechunk, COALESCECHUNK_TAG,   COALESCECHUNK,  1,                     MAXIMUMCOALESCECHUNK ) \
+  INT( guardtime,     GUARDTIME_TAG,       GUARDTIME,      MINIMUMGUARDTIME,      60000 ) \
+  INT( onlinecmds,    ONLINECOMMANDS_TAG,  ONLINECOMMANDS, 0,                     1 ) \
+  INT( powersave,     POWERSAVE_TAG,       POWERSAVE,      0,                     2 ) \
+  INT( takeover,      TAKEOVER_TAG,        TAKEOVER,       -1,                    0x7fffffff/1000 ) \
+  INT( nodelay,       NODELAY_TAG,         NODELAY,        0,                     1 ) \
+  INT( keepalive,     KEEPALIVE_TAG,       KEEPALIVE,      0,                     7200 ) \
+  INT( remoteport,    REMOTEPORT_TAG,      REMOTEPORT,     1,                     65535 ) \
+  STR( wifissid,      WIFISSID_TAG,        WIFISSID,       33,                    validText ) \
+  STR( wifipassword,  WIFIPASSWORD_TAG,    WIFIPASSWORD,   64,                    validText ) \
+  STR( hostname,      HOSTNAME_TAG,        HOSTNAME,       255,                   validText ) \
+  STR( otapw,         OTAPW_TAG,           OTAPW,          64,                    validText ) \
+  STR( remotehost,    REMOTEHOST_TAG,      REMOTEHOST,     64,                    validText ) \
+  STR( staticip,      STATICIP_TAG,        STATICIP,       16,                    validAddress ) \
+  STR( staticgateway, STATICGATEWAY_TAG,   STATICGATEWAY,  16,                    validAddress ) \
+  STR( staticmask,    STATICMASK_TAG,      STATICMASK,     16,                    validAddress ) \
+  STR( staticdns,     STATICDNS_TAG,       STATICDNS,      16,                    validAddress )
+
+
+// validators for text items, an invalid value is replaced by an empty one
+bool validText(const char *) { return true; }
+bool validAddress(const char *s) { return !*s || IPAddress().fromString(s); }
+
+
+// Our configuration structure.
+//
+// Never use a JsonDocument to store the configuration!
+// A JsonDocument is *not* a permanent storage; it's only a temporary storage
+// used during the serialization phase. See:
+// https://arduinojson.org/v6/faq/why-must-i-create-a-separate-config-object/
+#define CONFIG_INT_MEMBER(name, tag, def, lo, hi)             int name;
+#define CONFIG_STR_MEMBER(name, tag, def, size, valid)        char name[size];
+struct Config {
+    CONFIG_ITEMS(CONFIG_INT_MEMBER, CONFIG_STR_MEMBER)
+};
+
+// defaults have to be valid, checked at compile time
+#define CONFIG_INT_CHECK(name, tag, def, lo, hi)              static_assert((def)>=(lo) && (def)<=(hi), "default of " #name " out of range");
+#define CONFIG_STR_CHECK(name, tag, def, size, valid)         static_assert(sizeof(def)<=(size), "default of " #name " too long");
+CONFIG_ITEMS(CONFIG_INT_CHECK, CONFIG_STR_CHECK)
+
+// Longest JSON text of a configuration: every tag with its quotes and colon, the
+// widest int, every string at full length with its quotes, a comma each, the
+// braces and the terminating 0. The last item has no comma, which leaves the
+// byte serializeConfiguration needs to tell a full buffer from one that fits.
+// Characters that are escaped in JSON (\" and \\) take two bytes, a
+// configuration full of them may not fit and is not saved
+#define CONFIG_INT_JSONSIZE(name, tag, def, lo, hi)           +(sizeof(tag)+2)+11+1
+#define CONFIG_STR_JSONSIZE(name, tag, def, size, valid)      +(sizeof(tag)+2)+((size)+1)+1
+constexpr size_t JSONSIZE= 2 CONFIG_ITEMS(CONFIG_INT_JSONSIZE, CONFIG_STR_JSONSIZE) +1;
+
+#define CONFIG_ITEM_COUNT(...)                                +1
+constexpr size_t ConfigItemCount= 0 CONFIG_ITEMS(CONFIG_ITEM_COUNT, CONFIG_ITEM_COUNT);
+
+static_assert(JSONSIZE<=1536, "configuration JSON too long for the text buffer and the AT scanner's line");
+
+// The JSON text while a configuration is read from a file, written or printed,
+// with room for a "+++AT+CFG=" prefix and CR LF. It is static rather than on the
+// stack of each of them, which kept the +++AT+CFG= path deep in the 4 KB stack.
+// None of them calls another one while it holds text in here
+char ConfigText[JSONSIZE+16];
+
+// fingerprint of the schema (names, tags and sizes), a snapshot written by
+// firmware with a different schema is not loaded
+constexpr uint32_t configLayoutHash(const char *s, uint32_t h= 2166136261UL) {
+  return (*s ? configLayoutHash(s+1, (h^(uint8_t)*s)*16777619UL) : h);
+}
+#define CONFIG_INT_LAYOUT(name, tag, def, lo, hi)             #name ":" tag ":i,"
+#define CONFIG_STR_LAYOUT(name, tag, def, size, valid)        #name ":" tag ":s" #size ","
+constexpr uint32_t ConfigLayout= configLayoutHash(CONFIG_ITEMS(CONFIG_INT_LAYOUT, CONFIG_STR_LAYOUT));
+
+// fingerprint of the defaults, firmware with other defaults doesn't boot from
+// the snapshot but reads config.ini again, so its missing items get the new ones
+#define CONFIG_INT_DEFAULTS(name, tag, def, lo, hi)           h= (h^(uint32_t)(def))*16777619UL;
+#define CONFIG_STR_DEFAULTS(name, tag, def, size, valid)      h= configLayoutHash(def, h)*16777619UL;
+constexpr uint32_t configDefaultsHash() {
+  uint32_t h= 2166136261UL;
+  CONFIG_ITEMS(CONFIG_INT_DEFAULTS, CONFIG_STR_DEFAULTS)
+  return h;
+}
+constexpr uint32_t ConfigDefaults= configDefaultsHash();
+
 const char* CONFIGFILENAME= "/config.ini";
 const char* FAILSAFEFILENAME= "/failsafe.ini";
 
 Config GlobalConfig;                         // <- global configuration object
 
 
+// Binary copy of the configuration in the EEPROM flash sector.
+// Loading it needs neither a mounted LittleFS nor a JSON parser, the JSON files
+// remain the import/export format.
+#define CONFIGSNAPSHOT_MAGIC 0x30353847     // "G850"
+#ifndef CONFIGSNAPSHOT_VERSION
+#define CONFIGSNAPSHOT_VERSION 3            // bump whenever the meaning of a Config item changes
+#endif
+
+struct ConfigSnapshot {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                          // sizeof(Config)
+    uint32_t layout;                        // ConfigLayout, catches added, moved or resized items
+    uint32_t defaults;                      // ConfigDefaults
+    uint32_t commits;                       // times the sector was written, survives reboots
+    uint32_t erases[2];                     // lifetime erase estimate of config.ini and failsafe.ini
+    Config cfg;
+    uint32_t crc;                           // crc32 over everything above
+};
+
+
+// write counters of the configuration files and the snapshot
+// writes and skipped writes count since boot. erases estimates the flash blocks
+// a file's writes erased since the first boot: the blocks of the new content
+// plus one for the directory. it is kept in the snapshot header whenever that
+// is written, so what a file write adds after the last snapshot write is lost
+// on reboot
+struct StorageStats {
+    uint32_t writes;                        // times the content was written
+    uint32_t skipped;                       // writes saved because the content did not change
+    uint32_t erases;                        // flash blocks erased, estimated
+};
+
+StorageStats ConfigFileStats, FailSafeFileStats, SnapshotStats;
+uint32_t SnapshotCommits= 0;                // lifetime writes of the snapshot sector
+
+// counters of a configuration file, NULL for any other file
+StorageStats *storageStats(const char *filename) {
+  if (!strcmp(filename, CONFIGFILENAME))
+    return &ConfigFileStats;
+  if (!strcmp(filename, FAILSAFEFILENAME))
+    return &FailSafeFileStats;
+  return NULL;
+}
+
+// Prints the write counters as JSON
+void PrintStorageStats(Print &p) {
+  p.printf("{\"config\":[%u,%u,%u],\"failsafe\":[%u,%u,%u],\"snapshot\":[%u,%u,%u]}",
+    (unsigned)ConfigFileStats.writes, (unsigned)ConfigFileStats.skipped, (unsigned)ConfigFileStats.erases,
+    (unsigned)FailSafeFileStats.writes, (unsigned)FailSafeFileStats.skipped, (unsigned)FailSafeFileStats.erases,
+    (unsigned)SnapshotStats.writes, (unsigned)SnapshotStats.skipped, (unsigned)SnapshotCommits);
+}
+
+
+// crc32 (IEEE 802.3), bitwise to save the table
+// crc continues the crc of data that came before
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc= 0) {
+  crc= ~crc;
+  while(len--){
+    crc^= *data++;
+    for(int i=0; i<8; i++)
+      crc= (crc>>1)^(0xEDB88320 & (0-(crc&1)));
+  }
+  return ~crc;
+}
+
+
+// What applying a changed configuration needs to know about the one before: the
+// items that are applied on the fly by value, those that only take effect after
+// a restart as one crc. Small enough for the stack, unlike a copy of the Config
+struct ConfigDigest {
+    uint32_t restart;                       // crc32 over WiFi, host name, OTA password and static profile
+    int sleeptimeout;
+    int adaptsleep;
+    int sleepmin;
+    int sleepmax;
+    int softbaudrate;
+    int rawport;
+};
+
+ConfigDigest configDigest(const Config &cfg) {
+  const char *restart[]= {cfg.wifissid, cfg.wifipassword, cfg.hostname, cfg.otapw,
+                          cfg.staticip, cfg.staticgateway, cfg.staticmask, cfg.staticdns};
+  ConfigDigest digest;
+  digest.restart= 0;
+  for(const char *s : restart)
+    digest.restart= crc32((const uint8_t*)s, strlen(s)+1, digest.restart);   // with the 0, so "ab","c" differs from "a","bc"
+  digest.sleeptimeout= cfg.sleeptimeout;
+  digest.adaptsleep= cfg.adaptsleep;
+  digest.sleepmin= cfg.sleepmin;
+  digest.sleepmax= cfg.sleepmax;
+  digest.softbaudrate= cfg.softbaudrate;
+  digest.rawport= cfg.rawport;
+  return digest;
+}
+
+
+// mounts LittleFS on first use, a boot from the snapshot never needs it
+bool mountFileSystem() {
+  static bool mounted= false;
+  if(!mounted){
+    mounted= LittleFS.begin();
+    #ifdef DEBUG
+      Serial.println(mounted?"File system mounted":"File system error");
+    #endif
+  }
+  return mounted;
+}
+
+
 // Loads the default configuration
 void loadDefaultConfiguration(Config &cfg) {
-      cfg.revision = REVISION;
-      cfg.sleeptimeout = SLEEPTIMEOUT;
-      cfg.softbaudrate= SOFTBAUDRATE;
-      cfg.rawport= RAW_TCP_PORT;
-      strlcpy(cfg.wifissid,  WIFISSID, sizeof(cfg.wifissid));
-      strlcpy(cfg.wifipassword, WIFIPASSWORD, sizeof(cfg.wifipassword));
-      strlcpy(cfg.hostname, HOSTNAME, sizeof(cfg.hostname));
-      strlcpy(cfg.otapw, OTAPW, sizeof(cfg.otapw));
+  #define CONFIG_INT_DEFAULT(name, tag, def, lo, hi)          cfg.name= (def);
+  #define CONFIG_STR_DEFAULT(name, tag, def, size, valid)     strlcpy(cfg.name, (def), sizeof(cfg.name));
+  CONFIG_ITEMS(CONFIG_INT_DEFAULT, CONFIG_STR_DEFAULT)
+}
+
+// Clamps every item into its valid range
+void validateConfiguration(Config &cfg) {
+  #define CONFIG_INT_VALIDATE(name, tag, def, lo, hi)         cfg.name= (cfg.name<(lo) ? (lo) : (cfg.name>(hi) ? (hi) : cfg.name));
+  #define CONFIG_STR_VALIDATE(name, tag, def, size, valid)    cfg.name[(size)-1]= 0x0; if(!valid(cfg.name)) cfg.name[0]= 0x0;
+  CONFIG_ITEMS(CONFIG_INT_VALIDATE, CONFIG_STR_VALIDATE)
+}
+
+// Copies the items present in the JSON text to the Config, others keep their value.
+// The text is checked completely before anything is copied, so a broken one
+// leaves the Config untouched. Returns false in that case
+bool readConfigurationFromJson(Config &cfg, const char *json) {
+  JsonReader check(json);
+  while(check.next());
+  if(check.error())
+    return false;
+
+  JsonReader reader(json);
+  int32_t value;
+  while(reader.next()){
+    #define CONFIG_INT_FROMJSON(name, tag, def, lo, hi)       if(reader.key(tag)){ if(reader.integer(value)) cfg.name= value; } else
+    #define CONFIG_STR_FROMJSON(name, tag, def, size, valid)  if(reader.key(tag)){ reader.string(cfg.name, sizeof(cfg.name)); } else
+    CONFIG_ITEMS(CONFIG_INT_FROMJSON, CONFIG_STR_FROMJSON)
+    {}  // unknown key, ignored
+  }
+  validateConfiguration(cfg);
+  return true;
 }
 
 
 
-void saveConfiguration(const Config &cfg);
+void writeConfiguration(const Config &cfg, const char *filename);
+
+// Reads a JSON file into buf without the white space between its tokens, so a
+// pretty printed file needs no more room than the one we write. A single space
+// is kept where dropping it would join two values. Returns the length, or size
+// if the file doesn't fit even so
+size_t readCompactJson(File &file, char *buf, size_t size) {
+  size_t len= 0;
+  bool string= false, escape= false, space= false;
+  uint8_t chunk[64];
+  size_t n;
+  while((n= file.read(chunk, sizeof(chunk)))>0){
+    for(size_t i=0; i<n; i++){
+      char c= chunk[i];
+      if(string){
+        if(escape)
+          escape= false;
+        else if(c=='\\')
+          escape= true;
+        else if(c=='"')
+          string= false;
+      } else if(c==' ' || c=='\t' || c=='\r' || c=='\n'){
+        space= true;
+        continue;
+      } else {
+        if(space && len>0 && !strchr("{[,:", buf[len-1]) && !strchr("}],:", c)){
+          if(len>=size-1)
+            return size;
+          buf[len++]= ' ';
+        }
+        space= false;
+        string= (c=='"');
+      }
+      if(len>=size-1)
+        return size;
+      buf[len++]= c;
+    }
+  }
+  buf[len]= 0x0;
+  return len;
+}
 
-// Loads the configuration from a file or string
-void readConfigurationFromFile(Config &cfg, const char *filename) {
+// Loads the configuration from a file, missing values get their default.
+// Without the file the defaults are used and written to it. A file that can't
+// be used (broken or too long) is left alone for the user to fix, the
+// defaults are used and false is returned
+bool readConfigurationFromFile(Config &cfg, const char *filename) {
   #ifdef DEBUG
     Serial.println((String)"Loading Configuration" + filename  );
   #endif
 
-  // Allocate a temporary JsonDocument
-  // Don't forget to change the capacity to match your requirements.
-  // Use arduinojson.org/v6/assistant to compute the capacity.
-  StaticJsonDocument<JSONSIZE> doc;
-  DeserializationError error;
+  // The file is parsed in place, so it is read in one go
+  char *buf= ConfigText;
+  const size_t size= JSONSIZE+1;
+  size_t len= 0;
 
-  #ifdef DEBUG
-    Serial.println(F("deserialize from file"));
-  #endif
+  mountFileSystem();
   File file = LittleFS.open(filename, "r");
-  // Deserialize the JSON document
-  error = deserializeJson(doc, file);
+  if(!file){
+    #ifdef DEBUG
+      Serial.println(F("No file, using default configuration"));
+    #endif
+    loadDefaultConfiguration(cfg);
+    writeConfiguration(cfg, filename);
+    return true;
+  }
+  len= readCompactJson(file, buf, size);
   // Close the file (Curiously, File's destructor doesn't close the file)
   file.close();
 
-  if (error){
+  loadDefaultConfiguration(cfg);
+  if (len>=size || !readConfigurationFromJson(cfg, buf)){
     #ifdef DEBUG
       Serial.println(F("Failed to read file, using default configuration"));
     #endif
     loadDefaultConfiguration(cfg);
-    saveConfiguration(cfg);
-  }
-  else{
-    // Copy values from the JsonDocument to the Config
-    cfg.revision = doc[REVISION_TAG]|REVISION;
-    cfg.sleeptimeout = doc[SLEEPTIMEOUT_TAG]|SLEEPTIMEOUT;
-    cfg.sleeptimeout= ((cfg.sleeptimeout<60)?60:cfg.sleeptimeout);
-    cfg.softbaudrate= doc[SOFTBAUDRATE_TAG]|SOFTBAUDRATE;
-    cfg.rawport= doc[RAW_TCP_PORT_TAG]|RAW_TCP_PORT;
-    strlcpy(cfg.wifissid, doc[WIFISSID_TAG]|WIFISSID, sizeof(cfg.wifissid)); 
-    strlcpy(cfg.wifipassword, doc[WIFIPASSWORD_TAG]|WIFIPASSWORD, sizeof(cfg.wifipassword));
-    strlcpy(cfg.hostname, doc[HOSTNAME_TAG]|HOSTNAME, sizeof(cfg.hostname));         
-    strlcpy(cfg.otapw, doc[OTAPW_TAG]|OTAPW, sizeof(cfg.otapw));         
+    return false;
   }
+  return true;
 }
 
 
-// Loads the configuration from a file or string
-void readConfigurationFromStream(Config &cfg, char *buf) {
+// Loads the configuration from a string, missing values are left alone
+void readConfigurationFromStream(Config &cfg, const char *buf) {
   #ifdef DEBUG
     Serial.println("Loading Configuration from Stream");
   #endif
 
-  // Allocate a temporary JsonDocument
-  // Don't forget to change the capacity to match your requirements.
-  // Use arduinojson.org/v6/assistant to compute the capacity.
-  StaticJsonDocument<JSONSIZE> doc;
-  DeserializationError error;
-
-  #ifdef DEBUG
-    Serial.println(F("deserialize from buffer"));
-  #endif
-  error = deserializeJson(doc, buf);
-
-  if (error){
+  if (!readConfigurationFromJson(cfg, buf)){
     #ifdef DEBUG
-      Serial.println(F("Failed to read file, using default configuration"));
+      Serial.println(F("Failed to parse configuration, nothing changed"));
     #endif
   }
-  else{
-    // Copy values from the JsonDocument to the Config
-    cfg.revision = doc[REVISION_TAG]|cfg.revision;
-    cfg.sleeptimeout = doc[SLEEPTIMEOUT_TAG]|cfg.sleeptimeout;
-    cfg.sleeptimeout= ((cfg.sleeptimeout<MINIMUMSLEEPTIMEOUT)?MINIMUMSLEEPTIMEOUT:cfg.sleeptimeout);
-    cfg.softbaudrate= doc[SOFTBAUDRATE_TAG]|cfg.softbaudrate;
-    cfg.rawport= doc[RAW_TCP_PORT_TAG]| cfg.rawport;
-    strlcpy(cfg.wifissid, doc[WIFISSID_TAG]|cfg.wifissid, sizeof(cfg.wifissid)); 
-    strlcpy(cfg.wifipassword, doc[WIFIPASSWORD_TAG]|cfg.wifipassword, sizeof(cfg.wifipassword));
-    strlcpy(cfg.hostname, doc[HOSTNAME_TAG]|cfg.hostname, sizeof(cfg.hostname));         
-    strlcpy(cfg.otapw, doc[OTAPW_TAG]|cfg.otapw, sizeof(cfg.otapw));         
-  }
 }
 
 
@@ -201,47 +533,172 @@ void loadFailSafeConfiguration(Config &cfg){
   readConfigurationFromFile(cfg, FAILSAFEFILENAME);
 }
 
-void loadConfiguration(Config &cfg) {
-  readConfigurationFromFile(cfg, CONFIGFILENAME);
+// Loads the configuration from the snapshot, returns false if there is no valid one
+bool readConfigurationSnapshot(Config &cfg) {
+  EEPROM.begin(sizeof(ConfigSnapshot));
+  const ConfigSnapshot *snap= (const ConfigSnapshot*)EEPROM.getConstDataPtr();
+  bool header= snap->magic==CONFIGSNAPSHOT_MAGIC &&
+               snap->version==CONFIGSNAPSHOT_VERSION &&
+               snap->size==sizeof(Config) &&
+               snap->layout==ConfigLayout &&
+               snap->crc==crc32((const uint8_t*)snap, offsetof(ConfigSnapshot, crc));
+  // the counters are good even if the defaults changed
+  if(header){
+    SnapshotCommits= snap->commits;
+    ConfigFileStats.erases= snap->erases[0];
+    FailSafeFileStats.erases= snap->erases[1];
+  }
+  bool valid= header && snap->defaults==ConfigDefaults;
+  if(valid)
+    memcpy(&cfg, &snap->cfg, sizeof(Config));
+  EEPROM.end();
+
+  #ifdef DEBUG
+    Serial.println(valid?"Configuration snapshot loaded":"No valid configuration snapshot");
+  #endif
+  return valid;
 }
 
-  
-  
-void writeConfiguration(const Config &cfg, const char *filename){
-  // Delete existing file, otherwise the configuration is appended to the file
-  LittleFS.remove(filename);
-  // Open file for writing
-  File file = LittleFS.open(filename, "w");
-  if (!file) {
+// Stores the configuration as snapshot, flash is only written if it changed
+void writeConfigurationSnapshot(const Config &cfg) {
+  EEPROM.begin(sizeof(ConfigSnapshot));
+  const ConfigSnapshot *snap= (const ConfigSnapshot*)EEPROM.getConstDataPtr();
+  if(snap->magic!=CONFIGSNAPSHOT_MAGIC || snap->version!=CONFIGSNAPSHOT_VERSION ||
+     snap->size!=sizeof(Config) || snap->layout!=ConfigLayout || snap->defaults!=ConfigDefaults ||
+     memcmp(&snap->cfg, &cfg, sizeof(Config))){
+    ConfigSnapshot *data= (ConfigSnapshot*)EEPROM.getDataPtr();
+    bool known= (data->magic==CONFIGSNAPSHOT_MAGIC);
+    data->magic= CONFIGSNAPSHOT_MAGIC;
+    data->version= CONFIGSNAPSHOT_VERSION;
+    data->size= sizeof(Config);
+    data->layout= ConfigLayout;
+    data->defaults= ConfigDefaults;
+    data->commits= (known ? data->commits : SnapshotCommits)+1;
+    data->erases[0]= ConfigFileStats.erases;
+    data->erases[1]= FailSafeFileStats.erases;
+    memcpy(&data->cfg, &cfg, sizeof(Config));
+    data->crc= crc32((const uint8_t*)data, offsetof(ConfigSnapshot, crc));
+    EEPROM.commit();
+    SnapshotCommits= data->commits;
+    SnapshotStats.writes++;
     #ifdef DEBUG
-      Serial.println(F("Failed to create file"));
+      Serial.println("Configuration snapshot written");
     #endif
+  } else {
+    SnapshotStats.skipped++;
+  }
+  EEPROM.end();
+}
+
+// Loads the configuration, the snapshot first and config.ini only if there is no valid snapshot.
+// A config.ini uploaded later is not noticed, checking it would need LittleFS
+// on every boot, +++AT+LOAD picks it up
+void loadConfiguration(Config &cfg) {
+  if(readConfigurationSnapshot(cfg))
     return;
+  // no snapshot of the defaults a broken config.ini left us with, so it is
+  // read again on the next boot once it was fixed
+  if(readConfigurationFromFile(cfg, CONFIGFILENAME))
+    writeConfigurationSnapshot(cfg);
+}
+
+// Reloads config.ini, e.g. after it was uploaded with the LittleFS uploader
+void reloadConfiguration(Config &cfg) {
+  if(readConfigurationFromFile(cfg, CONFIGFILENAME))
+    writeConfigurationSnapshot(cfg);
+}
+
+  
+  
+// Serializes the configuration as JSON into buf, returns its length or 0 if it doesn't fit
+size_t serializeConfiguration(const Config &cfg, char *buf, size_t size){
+    // Tags and strings are linked, not copied, so one slot per item is all it needs
+    // static like ConfigText, the stack is better off without it
+    static StaticJsonDocument<JSON_OBJECT_SIZE(ConfigItemCount)> doc;
+    doc.clear();
+
+
+    // Copy values from the Config to the JsonDocument
+    #define CONFIG_INT_TOJSON(name, tag, def, lo, hi)         doc[tag]= cfg.name;
+    #define CONFIG_STR_TOJSON(name, tag, def, size, valid)    doc[tag]= (const char*)cfg.name;
+    CONFIG_ITEMS(CONFIG_INT_TOJSON, CONFIG_STR_TOJSON)
+
+    size_t len= serializeJson(doc, buf, size);
+    return ((len == 0 || len >= size-1) ? 0 : len);
+}
+
+
+// true if the file holds exactly the given data
+bool fileEquals(const char *filename, const char *data, size_t len) {
+  File file = LittleFS.open(filename, "r");
+  if (!file)
+    return false;
+
+  bool equal= (file.size()==len);
+  uint8_t chunk[64];
+  while(equal && len>0){
+    size_t n= file.read(chunk, (len<sizeof(chunk) ? len : sizeof(chunk)));
+    equal= (n>0 && memcmp(chunk, data, n)==0);
+    data+= n;
+    len-= n;
   }
+  file.close();
+  return equal;
+}
 
-    // Allocate a temporary JsonDocument
-    // Don't forget to change the capacity to match your requirements.
-    // Use arduinojson.org/assistant to compute the capacity.
-    StaticJsonDocument<JSONSIZE> doc;
-
-
-    // Copy values from the JsonDocument to the Config
-    doc[REVISION_TAG] = cfg.revision;
-    doc[SLEEPTIMEOUT_TAG] = cfg.sleeptimeout;
-    doc[SOFTBAUDRATE_TAG]=  cfg.softbaudrate;
-    doc[RAW_TCP_PORT_TAG]= cfg.rawport;
-    doc[WIFISSID_TAG]= cfg.wifissid;
-    doc[WIFIPASSWORD_TAG]= cfg.wifipassword;
-    doc[HOSTNAME_TAG] = cfg.hostname;
-    doc[OTAPW_TAG] = cfg.otapw;     
-    
-    // Serialize JSON to file
-    if (serializeJson(doc, file) == 0) {
-        Serial.println(F("Failed to write to file"));
+
+// Writes the configuration to a file
+// The file is only touched if its content changes, and the new content goes to a
+// temporary file first that is then renamed into place, so a power cut leaves
+// either the old or the new file but never none.
+void writeConfiguration(const Config &cfg, const char *filename){
+    // Serialize JSON to memory, so it can be compared with the file
+    char *json= ConfigText;
+    size_t len= serializeConfiguration(cfg, json, JSONSIZE);
+    if (len == 0) {
+      #ifdef DEBUG
+        Serial.println(F("Failed to serialize configuration"));
+      #endif
+      return;
+    }
+
+    StorageStats *stats= storageStats(filename);
+    mountFileSystem();
+    if (fileEquals(filename, json, len)) {
+      if (stats)
+        stats->skipped++;
+      #ifdef DEBUG
+        Serial.println(F("Configuration unchanged, not written"));
+      #endif
+      return;
     }
 
-    // Close the file
+    char tmpname[32];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+    File file = LittleFS.open(tmpname, "w");
+    if (!file) {
+      #ifdef DEBUG
+        Serial.println(F("Failed to create file"));
+      #endif
+      return;
+    }
+    size_t written= file.write((const uint8_t*)json, len);
     file.close();
+
+    // LittleFS replaces an existing file on rename in one step
+    if (written != len || !LittleFS.rename(tmpname, filename)) {
+      #ifdef DEBUG
+        Serial.println(F("Failed to write to file"));
+      #endif
+      LittleFS.remove(tmpname);
+      return;
+    }
+    if (stats) {
+      FSInfo info;
+      size_t block= (LittleFS.info(info) && info.blockSize ? info.blockSize : 4096);
+      stats->writes++;
+      stats->erases+= (len+block-1)/block+1;
+    }
 }
 
 void saveFailSafeConfiguration(const Config &cfg) {
@@ -249,9 +706,10 @@ void saveFailSafeConfiguration(const Config &cfg) {
 }
 
 
-// Saves the configuration to standard ini-file
+// Saves the configuration to standard ini-file and the snapshot
 void saveConfiguration(const Config &cfg){
   writeConfiguration( cfg, CONFIGFILENAME);
+  writeConfigurationSnapshot(cfg);
 }
 
 
@@ -261,28 +719,36 @@ void saveConfiguration(const Config &cfg){
 
 
 // Prints the content of a config file to the print object specified
+// the whole file is read into memory and handed over in one write, so a network
+// client gets it in one segment instead of one per character
 void PrintIniFile(Print &p, const char *filename) {
-
-  #ifdef DEBUG
+    char *buf= ConfigText;
+    mountFileSystem();
     // Open file for reading
     File file = LittleFS.open(filename, "r");
     if (!file) {
         #ifdef DEBUG
-          Serial.print(F("PrintCOnfig: Failed to read file"));
+          Serial.print(F("PrintConfig: Failed to read file"));
         #endif
         return;
     }
 
-    while (file.available()) {
-        p.print((char)file.read());
-    }
-    p.println();
+    size_t len= file.read((uint8_t*)buf, JSONSIZE);
     file.close();
-  #endif
+    buf[len++]= '\r';
+    buf[len++]= '\n';
+    p.write((const uint8_t*)buf, len);
 }
 
-void PrintConfig(Print &p) {
-  PrintIniFile(p, CONFIGFILENAME);
+// Prints the active configuration, serialized straight from memory behind an optional prefix
+void PrintConfig(Print &p, const char *prefix="") {
+  char *buf= ConfigText;
+  size_t len= strlcpy(buf, prefix, 16);
+  len= (len<16 ? len : 15);
+  len+= serializeConfiguration(GlobalConfig, buf+len, JSONSIZE);
+  buf[len++]= '\r';
+  buf[len++]= '\n';
+  p.write((const uint8_t*)buf, len);
 }
 
 void PrintFailSafeConfig(Print &p) {
@@ -35,9 +35,18 @@
 #include <ESP8266mDNS.h>
 #include <ArduinoOTA.h>
 #include <LittleFS.h>
-#include <Ticker.h>  
 #include "config.h"
 #include "ATScanner.h"
+#include "Bridge.h"
+#include "FastConnect.h"
+#include "WakeOnSerial.h"
+#include "PowerPolicy.h"
+#include "AdaptiveSleep.h"
+#include "Scheduler.h"
+#include "LedBlinker.h"
+#include "PrgButton.h"
+#include "Sessions.h"
+#include "Dialer.h"
 
 
 //below to ensure Strings from platformio.ini are handled as intended by pre-compiler
@@ -53,7 +62,6 @@
 #define LED_PIN 10
 #define LEDON 0x1
 #define LEDOFF 0x0
-const int BlinkDelay= 10; // blink period in ms
 
 // second button on the PCB should be PRG-pin
 #define PRG_PIN 0
@@ -62,12 +70,24 @@ const int BlinkDelay= 10; // blink period in ms
   #define SLEEPTIMER_DIV 10
 #endif
 
+// period of OTA, button and WiFi housekeeping in ms
+#ifndef HOUSEKEEPING_PERIOD
+  #define HOUSEKEEPING_PERIOD 20
+#endif
+
+// longest wait for I/O in one loop pass in ms, the housekeeping deadlines cut it shorter
+#ifndef LOOP_IDLE_LIMIT
+  #define LOOP_IDLE_LIMIT 100
+#endif
+
 
 
 //SoftSerial related objects
-#define BUFFER_SIZE 1024    
-byte buff[BUFFER_SIZE];
+#ifndef SOFTSERIAL_RX_BUFFER
+  #define SOFTSERIAL_RX_BUFFER 256    // bytes the RX interrupt can collect between two bridge passes
+#endif
 SoftwareSerial SoftSerial(RX_PIN, TX_PIN, true); // RX, TX, inverse_logic = true
+WakeOnSerial SerialWake(SoftSerial, RX_PIN, true);
 void GoTheFuckToSleep();
 ATScanner SoftATscanner(SoftSerial, GoTheFuckToSleep);
 
@@ -76,7 +96,43 @@ ATScanner SoftATscanner(SoftSerial, GoTheFuckToSleep);
 // global objects
 WiFiEventHandler gotIpEventHandler, disconnectedEventHandler;
 WiFiServer server(RAW_TCP_PORT);
-WiFiClient  client;
+WiFiClient  client;                           // the writer session
+Sessions sessions(server, client);
+Dialer dialer;                                // client mode, connects to the remote server
+FastConnect wifi;
+uint32_t ServerStartTime= 0;                  // ms after boot the server was started
+uint32_t WakeCount= 0;                        // light sleeps ended by the G850
+uint32_t WakeTime= 0;                         // ms after boot (awake time) of the last of these
+ATScanner NetATscanner(client, GoTheFuckToSleep);
+Bridge bridge(SoftSerial, client, sessions, SoftATscanner, NetATscanner);
+PowerPolicy power;
+Scheduler scheduler;
+AdaptiveSleep sleeptime;
+
+// print bridge statistics as JSON
+void PrintStats(Print &p){
+  p.printf("{\"txq\":%u,\"txdrain\":%u,\"txbusy\":%u,\"tx\":%u,\"rx\":%u,\"power\":[%u,%u,%u,%u],\"sleep\":[%u,%u,%u],\"clients\":[%u,%u,%u,%u,%u],\"tcp\":[%u,%u],\"dial\":[%u,%u,%u],\"hold\":[%u,%u],\"storage\":",
+    (unsigned)bridge.toSerialPending(), (unsigned)bridge.toSerialDrainTime(), (unsigned)bridge.toSerialBusyTime(),
+    (unsigned)bridge.toSerialBytes(), (unsigned)bridge.toNetBytes(),
+    (unsigned)power.time(WIFI_NONE_SLEEP), (unsigned)power.time(WIFI_MODEM_SLEEP), (unsigned)power.time(WIFI_LIGHT_SLEEP),
+    (unsigned)power.switches(),
+    (unsigned)sleeptime.timeout(), (unsigned)sleeptime.gap(), (unsigned)sleeptime.duration(),
+    (unsigned)sessions.writer(), (unsigned)sessions.monitors(), (unsigned)sessions.lagged(), (unsigned)sessions.rejected(),
+    (unsigned)sessions.takeovers(),
+    (unsigned)sessions.deferred(), (unsigned)sessions.partial(),
+    (unsigned)dialer.connects(), (unsigned)dialer.failures(), (unsigned)dialer.cached(),
+    (unsigned)bridge.held(), (unsigned)bridge.heldDropped());
+  PrintStorageStats(p);
+  p.print("}\r\n");
+}
+
+// print boot timing as JSON
+void PrintBootStats(Print &p){
+  uint32_t wakeconnect= ((WakeCount && wifi.connectTime()) ? wifi.connectTime()-WakeTime : 0);
+  p.printf("{\"server\":%u,\"connect\":%u,\"fast\":%u,\"wakes\":%u,\"wakeconnect\":%u}\r\n",
+    (unsigned)ServerStartTime, (unsigned)wifi.connectTime(), (unsigned)wifi.fast(),
+    (unsigned)WakeCount, (unsigned)wakeconnect);
+}
 
 void checkFlash(){
 #ifdef DEBUG
@@ -188,80 +244,13 @@ int GetBaudrate(int i){
 
 
 /////////////////////////////
-//what to do with our LED: 
-enum blinkstates {Off, Single, Double, Tripple, On} ;
-blinkstates blinkstate= Off;
-
-static void blinker(){
-
-
-  
-  #ifdef DEBUG
-    //Serial.print("*");
-  #endif
-
-
-  static int cycle= 0;
-  cycle++;
-  switch (blinkstate){
-    case Off: 
-      digitalWrite(LED_PIN, LEDOFF); 
-      cycle=0;
-    break;
-
-    case Single: 
-        switch(cycle){
-          case 1: digitalWrite(LED_PIN, LEDON); break; 
-          case 150: cycle=0; break;
-          default: digitalWrite(LED_PIN, LEDOFF); break;
-        }
-    break;
-        
-    case Double: 
-        switch(cycle){
-          case 1: digitalWrite(LED_PIN, LEDON); break; 
-          case 20: digitalWrite(LED_PIN, LEDON); break;
-          case 170: cycle=0; break;
-          default: digitalWrite(LED_PIN, LEDOFF); break;
-        }
-    break;
-    
-    case Tripple: 
-        switch(cycle){
-          case 1: digitalWrite(LED_PIN, LEDON); break; 
-          case 21: digitalWrite(LED_PIN, LEDON); break;
-          case 41: digitalWrite(LED_PIN, LEDON); break;
-          case 190: cycle=0; break;
-          default: digitalWrite(LED_PIN, LEDOFF); break;
-        }
-    break;
-    case On: 
-        digitalWrite(LED_PIN, LEDON); 
-        cycle=0;
-    break;
-
-    default: 
-      digitalWrite(LED_PIN, LEDOFF);
-    break;
-  }
-}
-
-void SetBlinker(blinkstates bs){
-  //set pin as output
-  static bool firstcall= true;
-  if(firstcall){
-      pinMode(LED_PIN, OUTPUT);
-      firstcall=false;
-  }
-
-  blinkstate= bs;
-}
-
-Ticker BlinkTimer(blinker, BlinkDelay, 0, MILLIS);
+//what to do with our LED: played back from the timer1 interrupt
+LedBlinker led(LED_PIN, LEDON);
 
 
 void GoTheFuckToSleep(){
-  digitalWrite(LED_PIN, LEDOFF);
+  bridge.drain();
+  led.play(LedBlinker::Off);
   delay(500);
   while(true){
     ESP.deepSleep(0);   
@@ -272,6 +261,7 @@ void GoTheFuckToSleep(){
 //////////////////////////////////
 // sleep-timout related stuff:
 int sleepCountdown=0;
+uint32_t LastActivity=0;
 static void SleepCheck(){
   #ifdef DEBUG
     Serial.println("Going to sleep");
@@ -280,118 +270,209 @@ static void SleepCheck(){
   sleepCountdown++;
 
   if(sleepCountdown==(SLEEPTIMER_DIV-1)){
-    SetBlinker(Double);
+    led.play(LedBlinker::Double);
   } else  if(sleepCountdown==SLEEPTIMER_DIV){
-    SetBlinker(Tripple);
+    led.play(LedBlinker::Tripple);
   } else if(sleepCountdown>SLEEPTIMER_DIV){
+    sleeptime.timedOut();
     GoTheFuckToSleep();
   } else
-    SetBlinker(Single);
+    led.play(LedBlinker::Single);
 
 }
 
-Ticker SleepTimer(SleepCheck, 30000/SLEEPTIMER_DIV, 0, MILLIS);  //we need to create on the heap otherwise the sleeptimeout is not known
+Timer SleepTimer(scheduler, SleepCheck, 30000/SLEEPTIMER_DIV);
 
 
+// the sleep timeout is either configured or learned
+void SleepTimerInterval(){
+  SleepTimer.interval((sleeptime.timeout()*1000)/SLEEPTIMER_DIV);
+}
+
 void SleepTimerRestart(){
   sleepCountdown=0;
-  SetBlinker(Single);
+  LastActivity= millis();
+  led.play(LedBlinker::Single);
   SleepTimer.start(); //reset timer
 }
 
-// Reset the sleep timer upon button release
+// ms what the G850 sends after waking up is kept for the next client
+#ifndef WAKE_HOLDTIME
+  #define WAKE_HOLDTIME 30000
+#endif
+
+// light sleep with WiFi off until the G850 sends something, deep sleep if
+// it stays silent until the sleep timeout. what the G850 sends after waking
+// up is kept for the next client while WiFi comes back
+void Doze(){
+  uint32_t timeout= sleeptime.timeout()*1000;
+  uint32_t idle= millis()-LastActivity;
+  #ifdef DEBUG
+    Serial.println("Dozing");
+  #endif
+
+  led.play(LedBlinker::Off);
+  WiFi.mode(WIFI_OFF);
+  // a wake up counts when a character follows within 10 character times
+  uint32_t grace= 100000UL/GlobalConfig.softbaudrate+10;
+  if(!SerialWake.sleep((timeout>idle ? timeout-idle : 0), grace)){
+    sleeptime.timedOut();
+    GoTheFuckToSleep();
+  }
+
+  WakeCount++;
+  WakeTime= millis();
+  bridge.hold(WAKE_HOLDTIME);
+  WiFi.mode(WIFI_STA);
+  wifi.begin(GlobalConfig);
+  SleepTimerRestart();
+  #ifdef DEBUG
+    Serial.println("Woke up");
+  #endif
+}
+
+// ms the PRG button has to be held to restore the failsafe configuration
+#ifndef BUTTONPRESSTIME
+  #define BUTTONPRESSTIME 5000
+#endif
+
+PrgButton prg(PRG_PIN, BUTTONPRESSTIME);
+
+// act on the PRG button presses the interrupt posted
 void CheckPrgButton(){
-  const unsigned long BUTTONPRESSTIME= 5000;        // duration of keypress
+  uint8_t events= prg.events();
+
+  if(events & PrgButton::Long){   // button was pressed longer than the timeout time
+    #ifdef DEBUG
+      Serial.println("PRG button: restoring failsafe config");
+    #endif      
+    loadFailSafeConfiguration(GlobalConfig);
+    saveConfiguration(GlobalConfig);
+    #ifdef DEBUG
+      Serial.println("restarting with failsafe config");
+    #endif  
+    delay(1000);
+    ESP.reset();
+  } else if(events & PrgButton::Short){   // was only pressed briefly
+    #ifdef DEBUG
+      Serial.println("PRG button: timer reset");
+    #endif
+    SleepTimerRestart();  //payload
+  }
+}
 
 
-  //set PRG pin as input when called first time
-  static bool firstcall= true;
-  if(firstcall){
-    pinMode(PRG_PIN, INPUT);
-    firstcall=false;
+
+// apply a changed configuration to the running system
+// returns true if one of the changed items only takes effect after a restart
+bool ApplyConfiguration(const ConfigDigest &previous){
+  ConfigDigest current= configDigest(GlobalConfig);
+  // the answer to the command still goes out at the old line speed
+  bridge.drain();
+  if(previous.restart!=current.restart){
+    #ifdef DEBUG
+      Serial.println("ApplyConfiguration: restart needed");
+    #endif
+    return true;
   }
 
+  if(previous.softbaudrate!=current.softbaudrate){
+    SoftSerial.end();
+    SoftSerial.begin(GlobalConfig.softbaudrate, SWSERIAL_8N1, RX_PIN, TX_PIN, true, SOFTSERIAL_RX_BUFFER);
+  }
+  bridge.coalesce(GlobalConfig.coalescegap, GlobalConfig.coalescechunk);
+  bridge.baudrate(GlobalConfig.softbaudrate);
+  bridge.guardTime(GlobalConfig.guardtime);
+  bridge.onlineCommands(GlobalConfig.onlinecmds);
+  power.level(GlobalConfig.powersave);
+  sessions.takeover(GlobalConfig.takeover);
+  sessions.options(GlobalConfig.nodelay, GlobalConfig.keepalive);
+  dialer.configure(GlobalConfig);
+
+  if(previous.sleeptimeout!=current.sleeptimeout || previous.adaptsleep!=current.adaptsleep ||
+     previous.sleepmin!=current.sleepmin || previous.sleepmax!=current.sleepmax){
+    sleeptime.configure(GlobalConfig);
+    SleepTimerInterval();
+    SleepTimerRestart();
+  }
 
-  static bool wasPressed= false;
-  static unsigned long lastpress= 0;
-
-
-  if(digitalRead(PRG_PIN)==LOW){ //button pressed
-    if(wasPressed==false){      // first time that happpened
-    wasPressed= true;           // let's remember that
-    lastpress=millis();         // and when that happened
-    } else {                    // wasPressed flag was already set
-      //not really doing anything here...
-    }
-  } else{ //button not pressed
-    if(wasPressed==true){   // but it was pressed just a moment ago
-      wasPressed= false;    // let's reset that memory
-
-      if((lastpress+BUTTONPRESSTIME)<millis()){   // button was pressed longer than the timeout time
-        #ifdef DEBUG
-          Serial.println("PRG button: restoring failsafe config");
-        #endif      
-        loadFailSafeConfiguration(GlobalConfig);
-        saveConfiguration(GlobalConfig);
-        #ifdef DEBUG
-          Serial.println("restarting with failsafe config");
-        #endif  
-        delay(1000);
-        ESP.reset();
-      } else{                                       // was only pressed briefly
-        #ifdef DEBUG
-          Serial.println("PRG button: timer reset");
-        #endif
-        SleepTimerRestart();  //payload
-      }
-
-    }
+  if(previous.rawport!=current.rawport){
+    server.stop();  // a client connected to the old port stays connected
+    server.begin(GlobalConfig.rawport);
   }
+
+  #ifdef DEBUG
+    Serial.println("ApplyConfiguration: applied");
+  #endif
+  return false;
+}
+
+
+// OTA, button and WiFi at their regular deadline, dozing off when nobody needs us
+void Housekeeping(){
+  ArduinoOTA.handle();
+  CheckPrgButton();
+  wifi.poll(GlobalConfig);
+  if(!sessions.any() && GlobalConfig.dozetimeout && (millis()-LastActivity)>=(uint32_t)GlobalConfig.dozetimeout*1000)
+    Doze();
 }
 
+Timer HousekeepingTimer(scheduler, Housekeeping, HOUSEKEEPING_PERIOD);
 
+// true while there is I/O for the bridge, ends the idle wait of the loop
+bool IOReady(){
+  if(SoftSerial.available()>0 || server.hasClient() || dialer.ready())
+    return true;
+  if(!sessions.writer())
+    return false;
+  return client.available()>0 || bridge.toSerialPending()>0 ||
+         (bridge.toNetPending()>0 && client.availableForWrite()>0);
+}
 
 
 void setup() {
   #ifdef DEBUG
     Serial.begin(9600);
   #endif
-  
-  if (LittleFS.begin()){
-    #ifdef DEBUG
-      Serial.println("File system mounted");
-    #endif
-  }
-  else {
-    #ifdef DEBUG
-      Serial.println("File system error");
-    #endif
-  }
 
+  // the snapshot gets us going without mounting LittleFS
   loadConfiguration(GlobalConfig);
   #ifdef DEBUG
     PrintConfig(Serial);
     checkFlash();
+    mountFileSystem();
     listAllFilesInDir("/");
   #endif
 
-  SleepTimer.interval((GlobalConfig.sleeptimeout*1000)/SLEEPTIMER_DIV);
+  sleeptime.begin(GlobalConfig);
+  SleepTimerInterval();
   SleepTimer.start();
-  SetBlinker(On);
-  BlinkTimer.start();  
-
-  SoftSerial.begin(GlobalConfig.softbaudrate);
+  led.begin();
+  led.play(LedBlinker::On);
+  prg.begin();
+
+  SoftSerial.begin(GlobalConfig.softbaudrate, SWSERIAL_8N1, RX_PIN, TX_PIN, true, SOFTSERIAL_RX_BUFFER);
+  bridge.coalesce(GlobalConfig.coalescegap, GlobalConfig.coalescechunk);
+  bridge.baudrate(GlobalConfig.softbaudrate);
+  bridge.guardTime(GlobalConfig.guardtime);
+  bridge.onlineCommands(GlobalConfig.onlinecmds);
+  power.level(GlobalConfig.powersave);
+  sessions.takeover(GlobalConfig.takeover);
+  sessions.options(GlobalConfig.nodelay, GlobalConfig.keepalive);
+  dialer.configure(GlobalConfig);
 
   //WiFi stuff:
-  WiFi.begin(GlobalConfig.wifissid, GlobalConfig.wifipassword);
+  //the credentials live in the configuration, no need to have the SDK write them to flash
+  WiFi.persistent(false);
   WiFi.setAutoReconnect(true);
-  WiFi.persistent(true);
+  wifi.begin(GlobalConfig);
   gotIpEventHandler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP& event)
   {
     WiFi.setHostname(GlobalConfig.hostname);
-    SetBlinker(Single);
+    wifi.connected(GlobalConfig);
+    led.play(LedBlinker::Single);
     #ifdef DEBUG
-      Serial.print("Station connected, IP: ");
+      Serial.print(FastConnect::isStatic(GlobalConfig) ? "Station connected, static IP: " : "Station connected, IP: ");
       Serial.println(WiFi.localIP());
       Serial.print("Hostname:");
       Serial.println(WiFi.getHostname());
@@ -399,7 +480,7 @@ void setup() {
   });
   disconnectedEventHandler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected& event)
   {
-    SetBlinker(On);
+    led.play(LedBlinker::On);
     #ifdef DEBUG
       Serial.println("Station disconnected");
     #endif
@@ -410,76 +491,63 @@ void setup() {
 
 
   server.begin(GlobalConfig.rawport);
+  ServerStartTime= millis();
   #ifdef DEBUG
     Serial.println("servers started");
   #endif
   SleepTimer.start();
+  HousekeepingTimer.start();
 }
 
 
 void loop() {
-  //static unsigned long timer=millis();
-  int size = 0;
-
-  client = server.available();              //wait for client connection 
-
-  if (client){
+  // clients coming and going, only the writer makes a session
+  uint32_t now= millis();
+  Sessions::Event event= sessions.poll(now);
+
+  // client mode: without writer the bridge keeps what the G850 sends and
+  // once there is something, the adapter connects to the remote server.
+  // the connect runs in the background, the bridge goes on reading meanwhile
+  if(dialer.enabled() && !sessions.writer()){
+    bridge.hold();
+    WiFiClient remote;
+    if(event==Sessions::None && (dialer.dialing() || bridge.held()>0) && dialer.dial(remote, now))
+      event= sessions.adopt(remote, millis());
+  } else if(dialer.dialing()){
+    dialer.cancel();        // a client connected to us first
+  }
 
-    //clear any bytes received
-    while(SoftSerial.available()>0)  {  
-      SoftSerial.read();  
-    }
+  switch(event){
+    case Sessions::Takeover:
+      sleeptime.sessionEnd(millis());
+      // fall through, the new writer starts its session
+    case Sessions::WriterStart:
+      //clear any bytes received
+      bridge.reset();
+      sleeptime.sessionStart(millis());
+      SleepTimerInterval();
+    break;
 
-    while (client.connected()) {
-      ATScanner netscanner(client, GoTheFuckToSleep);
-    
-      // read data from wifi client and send to serial
-      while ((size = client.available())) {
-            size = (size >= BUFFER_SIZE ? BUFFER_SIZE : size);
-            client.read(buff, size);
-            netscanner.scan(buff, size);
-            SoftSerial.write(buff, size);
-            SoftSerial.flush();
-            SleepTimerRestart();
-            BlinkTimer.update();
-      }
-    
-      // read data from serial and send to wifi client
-      while ((size = SoftSerial.available())) {
-            size = (size >= BUFFER_SIZE ? BUFFER_SIZE : size);
-            SoftSerial.readBytes(buff, size);
-            SoftATscanner.scan(buff, size);
-            client.write(buff, size);
-            client.flush();
-            SleepTimerRestart();
-            BlinkTimer.update();
-      }
-      
-      SleepTimer.update();
-      BlinkTimer.update();
-      ArduinoOTA.handle();
-      CheckPrgButton();
-    }
-
-    client.stop();    
-  }
+    case Sessions::WriterEnd:
+      sleeptime.sessionEnd(millis());
+    break;
 
+    case Sessions::MonitorStart:
+      SleepTimerRestart();    // someone is watching
+    break;
 
-  //no longer connected
-  //keep watching serial port for commands
-  while ((size = SoftSerial.available())) {
-        size = (size >= BUFFER_SIZE ? BUFFER_SIZE : size);
-        SoftSerial.readBytes(buff, size);
-        SoftATscanner.scan(buff, size);
-        SleepTimerRestart();
-        BlinkTimer.update();
-        CheckPrgButton();
+    default:
+    break;
   }
 
+  // move a slice in each direction wifi<->serial
+  // without a writer the serial port is only watched for commands and by the monitors
+  if(bridge.service())
+    SleepTimerRestart();
+  power.poll(sessions.writer(), bridge.toSerialBytes()+bridge.toNetBytes(), millis());
 
-  SleepTimer.update();
-  BlinkTimer.update();
-  ArduinoOTA.handle();
-  CheckPrgButton();
-  delay(5); // w/o this delay., OTA gives you trouble
+  // housekeeping that is due, then wait for I/O or the next deadline
+  // no waiting at all while a transfer is under way
+  scheduler.run();
+  scheduler.idle((power.active() ? 0 : LOOP_IDLE_LIMIT), IOReady);
 }
@@ -0,0 +1,70 @@
+//boot time cost of each configuration backend, on the adapter itself:
+//the EEPROM snapshot against mounting LittleFS and parsing config.ini
+//uses its own file, config.ini and the snapshot of the adapter are left as they are
+#undef DEBUG                      // no debug output inside the timed code
+#include <unity.h>
+#include <Arduino.h>
+#include "config.h"
+
+const char *BenchFile= "/bench.ini";
+const int Rounds= 20;
+
+//mean time of a call in us
+template <class Load>
+uint32_t measure(Load load){
+  uint32_t total= 0;
+  for(int n=0; n<Rounds; n++){
+    uint32_t start= micros();
+    load();
+    total+= micros()-start;
+    yield();
+  }
+  return total/Rounds;
+}
+
+void report(const char *what, uint32_t us){
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%-20s %6u us", what, (unsigned)us);
+  TEST_MESSAGE(msg);
+}
+
+
+void test_load_time(){
+  Config cfg;
+  loadConfiguration(GlobalConfig);      // makes sure there is a snapshot
+  writeConfiguration(GlobalConfig, BenchFile);
+
+  char json[JSONSIZE];
+  TEST_ASSERT_TRUE(serializeConfiguration(GlobalConfig, json, sizeof(json))>0);
+
+  uint32_t snapshot= measure([&](){ TEST_ASSERT_TRUE(readConfigurationSnapshot(cfg)); });
+  uint32_t mount= measure([](){ LittleFS.end(); LittleFS.begin(); });
+  uint32_t file= measure([&](){ readConfigurationFromFile(cfg, BenchFile); });
+  uint32_t parse= measure([&](){ loadDefaultConfiguration(cfg); readConfigurationFromJson(cfg, json); });
+  LittleFS.remove(BenchFile);
+
+  report("snapshot", snapshot);
+  report("LittleFS mount", mount);
+  report("config file+JSON", file);
+  report("  of that JSON", parse);
+  report("LittleFS boot", mount+file);
+
+  //every backend got the same configuration
+  char loaded[JSONSIZE];
+  size_t len= serializeConfiguration(cfg, loaded, sizeof(loaded));
+  TEST_ASSERT_TRUE(len>0 && strcmp(loaded, json)==0);
+  TEST_ASSERT_TRUE(snapshot<mount+file);
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+void setup(){
+  delay(2000);                    // the serial monitor needs a moment after the reset
+  UNITY_BEGIN();
+  RUN_TEST(test_load_time);
+  UNITY_END();
+}
+
+void loop(){}
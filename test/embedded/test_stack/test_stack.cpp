@@ -0,0 +1,117 @@
+//stack needed to parse a configuration on the adapter: JsonReader in place
+//against deserializing into a JsonDocument, as config.h did before, and the
+//whole +++AT+CFG= command with saving and printing the result
+#undef DEBUG                      // no debug output inside the measured code
+#include <unity.h>
+#include <Arduino.h>
+#include "config.h"
+#include "ATScanner.h"
+
+//provided by main on the adapter
+void PrintStats(Print &p){}
+void PrintBootStats(Print &p){}
+bool ApplyConfiguration(const ConfigDigest &previous){ return false; }
+void sleepRoutine(){}
+
+//the command's answer is only counted
+class Discard : public Print {
+public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override { bytes+= size; return size; }
+  size_t bytes= 0;
+};
+
+//the way it was: deserialize, then copy every item out of the document
+bool __attribute__((noinline)) loadWithDocument(Config &cfg, char *json){
+  StaticJsonDocument<JSON_OBJECT_SIZE(ConfigItemCount)> doc;
+  if(deserializeJson(doc, json))
+    return false;
+  #define CONFIG_INT_FROMDOC(name, tag, def, lo, hi)        cfg.name= doc[tag] | cfg.name;
+  #define CONFIG_STR_FROMDOC(name, tag, def, size, valid)   if(const char *s= doc[tag]) strlcpy(cfg.name, s, sizeof(cfg.name));
+  CONFIG_ITEMS(CONFIG_INT_FROMDOC, CONFIG_STR_FROMDOC)
+  validateConfiguration(cfg);
+  return true;
+}
+
+bool __attribute__((noinline)) loadWithReader(Config &cfg, const char *json){
+  return readConfigurationFromJson(cfg, json);
+}
+
+//bytes of the cont stack a call used, from the painted stack's low water mark
+template <class Call>
+uint32_t stackUse(Call call){
+  ESP.resetFreeContStack();
+  uint32_t free= ESP.getFreeContStack();
+  call();
+  return free-ESP.getFreeContStack();
+}
+
+
+void test_parse_stack(){
+  Config cfg;
+  loadDefaultConfiguration(cfg);
+  strlcpy(cfg.wifissid, "FRITZ!Box 7590 XY", sizeof(cfg.wifissid));
+  strlcpy(cfg.remotehost, "archive.example.org", sizeof(cfg.remotehost));
+  char json[JSONSIZE], copy[JSONSIZE];
+  TEST_ASSERT_TRUE(serializeConfiguration(cfg, json, sizeof(json))>0);
+
+  Config a, b;
+  loadDefaultConfiguration(a);
+  loadDefaultConfiguration(b);
+  strcpy(copy, json);               // deserializeJson works in place and changes it
+  uint32_t document= stackUse([&](){ TEST_ASSERT_TRUE(loadWithDocument(a, copy)); });
+  uint32_t reader= stackUse([&](){ TEST_ASSERT_TRUE(loadWithReader(b, json)); });
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "JsonDocument %u bytes, JsonReader %u bytes", (unsigned)document, (unsigned)reader);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL_STRING(a.wifissid, b.wifissid);
+  TEST_ASSERT_EQUAL_STRING(a.remotehost, b.remotehost);
+  TEST_ASSERT_EQUAL(a.sleeptimeout, b.sleeptimeout);
+  TEST_ASSERT_TRUE(reader<document);
+}
+
+
+//+++AT+CFG= as the G850 sends it: parse, write config.ini and the snapshot,
+//print the result. the adapter's configuration is put back afterwards
+void test_command_stack(){
+  loadConfiguration(GlobalConfig);
+  Config saved= GlobalConfig;
+  Config changed= GlobalConfig;
+  changed.coalescegap= (saved.coalescegap==7 ? 8 : 7);
+
+  static char line[ATLineSize+2];
+  Discard out;
+  ATScanner scanner(out, sleepRoutine);
+  uint32_t use= 0;
+  for(const Config *cfg : {&changed, &saved}){
+    size_t len= strlcpy(line, "+++AT+CFG=", sizeof(line));
+    len+= serializeConfiguration(*cfg, line+len, sizeof(line)-len-2);
+    line[len++]= '\n';
+    uint32_t n= stackUse([&](){ scanner.scan((const uint8_t*)line, len); });
+    use= (n>use ? n : use);
+  }
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "+++AT+CFG= %u bytes", (unsigned)use);
+  TEST_MESSAGE(msg);
+
+  TEST_ASSERT_EQUAL(saved.coalescegap, GlobalConfig.coalescegap);
+  TEST_ASSERT_TRUE(out.bytes>0);
+  TEST_ASSERT_LESS_THAN(1024, use);
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+void setup(){
+  delay(2000);                    // the serial monitor needs a moment after the reset
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_stack);
+  RUN_TEST(test_command_stack);
+  UNITY_END();
+}
+
+void loop(){}
@@ -0,0 +1,150 @@
+#ifndef MOCK_ARDUINO_H
+  #define MOCK_ARDUINO_H
+
+  //just enough of the ESP8266 Arduino core to run the bridge and the
+  //configuration code on the host, see platformio.ini [env:native]
+
+  #include <stdint.h>
+  #include <stddef.h>
+  #include <stdio.h>
+  #include <stdlib.h>
+  #include <string.h>
+  #include <stdarg.h>
+  #include <string>
+  #include <vector>
+
+  #define IRAM_ATTR
+  #define PROGMEM
+  #define F(s) (s)
+  #define HIGH 1
+  #define LOW 0
+  #define INPUT 0
+  #define OUTPUT 1
+  #define DEC 10
+  #define HEX 16
+
+  typedef uint8_t byte;
+
+  //the clock, tests move it on by hand
+  namespace mock {
+    inline uint64_t time= 0;      // us
+
+    inline void advance(uint32_t us){ time+= us; }
+
+    //e.g. just before millis() wraps
+    inline void setMillis(uint32_t ms){ time= (uint64_t)ms*1000; }
+  }
+
+  inline unsigned long millis(){ return (uint32_t)(mock::time/1000); }
+  inline unsigned long micros(){ return (uint32_t)mock::time; }
+  inline void delay(unsigned long ms){ mock::advance(ms*1000); }
+  inline void yield(){}
+
+  #if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+    inline size_t strlcpy(char *dst, const char *src, size_t size){
+      size_t len= strlen(src);
+      if(size){
+        size_t n= (len<size ? len : size-1);
+        memcpy(dst, src, n);
+        dst[n]= 0x0;
+      }
+      return len;
+    }
+  #endif
+
+  class String : public std::string {
+  public:
+    String(const char *s=""):std::string(s){}
+    String(const std::string &s):std::string(s){}
+    String operator+(const char *s) const { return String(std::string(*this)+s); }
+  };
+
+  class Print {
+  public:
+    virtual ~Print(){}
+    virtual size_t write(uint8_t c)= 0;
+    virtual size_t write(const uint8_t *buffer, size_t size){
+      size_t n= 0;
+      while(n<size && write(buffer[n]))
+        n++;
+      return n;
+    }
+    size_t write(const char *s){ return write((const uint8_t*)s, strlen(s)); }
+    virtual int availableForWrite(){ return 0; }
+
+    size_t print(const char *s){ return write(s); }
+    size_t print(const String &s){ return write(s.c_str()); }
+    size_t print(char c){ return write((uint8_t)c); }
+    size_t print(long v){ return printf("%ld", v); }
+    size_t print(unsigned long v){ return printf("%lu", v); }
+    size_t print(int v){ return print((long)v); }
+    size_t print(unsigned v){ return print((unsigned long)v); }
+    size_t println(){ return write("\r\n"); }
+    template <class T>
+    size_t println(const T &v){ return print(v)+println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))){
+      va_list args;
+      va_start(args, format);
+      int len= vsnprintf(nullptr, 0, format, args);
+      va_end(args);
+      std::vector<char> buf(len+1);
+      va_start(args, format);
+      vsnprintf(buf.data(), buf.size(), format, args);
+      va_end(args);
+      return write((const uint8_t*)buf.data(), len);
+    }
+  };
+
+  class Stream : public Print {
+  public:
+    virtual int available()= 0;
+    virtual int read()= 0;
+    virtual int peek()= 0;
+    virtual size_t readBytes(uint8_t *buffer, size_t size){
+      size_t n= 0;
+      int c;
+      while(n<size && (c= read())>=0)
+        buffer[n++]= c;
+      return n;
+    }
+    void setTimeout(unsigned long){}
+  };
+
+  //the debug output goes nowhere
+  class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long){}
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+  };
+
+  inline HardwareSerial Serial;
+
+  class EspClass {
+  public:
+    void reset(){ resets++; }
+    unsigned resets= 0;
+
+    //RTC user memory, offset in 4 byte blocks
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size){
+      if(offset*4+size>sizeof(rtc))
+        return false;
+      memcpy(data, rtc+offset, size);
+      return true;
+    }
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size){
+      if(offset*4+size>sizeof(rtc))
+        return false;
+      memcpy(rtc+offset, data, size);
+      return true;
+    }
+    uint32_t rtc[128]= {0};
+  };
+
+  inline EspClass ESP;
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MOCK_EEPROM_H
+  #define MOCK_EEPROM_H
+
+  #include <Arduino.h>
+
+  //the EEPROM emulation: begin() copies the flash sector to RAM, commit() writes it back
+  class EEPROMClass {
+  public:
+    void begin(size_t size){
+      m_size= (size<sizeof(flash) ? size : sizeof(flash));
+      memcpy(m_data, flash, m_size);
+    }
+
+    const uint8_t *getConstDataPtr() const { return m_data; }
+    uint8_t *getDataPtr(){ return m_data; }
+
+    bool commit(){
+      memcpy(flash, m_data, m_size);
+      commits++;
+      return true;
+    }
+
+    bool end(){ return true; }
+
+    uint8_t flash[4096]= {0};
+    unsigned commits= 0;
+
+  protected:
+    uint8_t m_data[4096];
+    size_t m_size= 0;
+  };
+
+  inline EEPROMClass EEPROM;
+
+#endif
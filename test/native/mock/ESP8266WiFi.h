@@ -0,0 +1,90 @@
+#ifndef MOCK_ESP8266WIFI_H
+  #define MOCK_ESP8266WIFI_H
+
+  #include <Arduino.h>
+  #include <IPAddress.h>
+  #include <deque>
+  #include <memory>
+
+  //both ends of a TCP connection, the test plays the peer
+  struct Socket {
+    std::deque<uint8_t> rx;       // sent by the peer, not read yet
+    std::string tx;               // received by the peer
+    size_t window= 1460;          // send buffer
+    size_t inflight= 0;           // bytes in the send buffer, the peer acks them
+    bool open= true;
+
+    void ack(){ inflight= 0; }
+  };
+
+  class WiFiClient : public Stream {
+  public:
+    WiFiClient(){}
+    WiFiClient(std::shared_ptr<Socket> socket):m_socket(socket){}
+
+    operator bool() const { return m_socket!=nullptr; }
+    uint8_t connected() const { return m_socket && m_socket->open; }
+    void stop(){
+      if(m_socket)
+        m_socket->open= false;
+    }
+
+    int available() override { return (m_socket ? m_socket->rx.size() : 0); }
+    int read() override {
+      if(!available())
+        return -1;
+      int c= m_socket->rx.front();
+      m_socket->rx.pop_front();
+      return c;
+    }
+    int read(uint8_t *buffer, size_t size){ return readBytes(buffer, size); }
+    int peek() override { return (available() ? m_socket->rx.front() : -1); }
+
+    int availableForWrite() override {
+      return (connected() ? m_socket->window-m_socket->inflight : 0);
+    }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override {
+      size_t room= availableForWrite();
+      size= (size<room ? size : room);
+      if(size){
+        m_socket->tx.append((const char*)buffer, size);
+        m_socket->inflight+= size;
+      }
+      return size;
+    }
+    using Print::write;
+
+    void setNoDelay(bool){}
+    void keepAlive(uint16_t, uint16_t, uint8_t){}
+    void disableKeepAlive(){}
+
+  protected:
+    std::shared_ptr<Socket> m_socket;
+  };
+
+  class WiFiServer {
+  public:
+    WiFiServer(uint16_t){}
+
+    bool hasClient() const { return !m_waiting.empty(); }
+    WiFiClient available(){
+      if(m_waiting.empty())
+        return WiFiClient();
+      WiFiClient client= m_waiting.front();
+      m_waiting.pop_front();
+      return client;
+    }
+
+    //a peer connects, returns its end of the connection
+    std::shared_ptr<Socket> connect(){
+      std::shared_ptr<Socket> socket= std::make_shared<Socket>();
+      m_waiting.push_back(WiFiClient(socket));
+      return socket;
+    }
+
+  protected:
+    std::deque<WiFiClient> m_waiting;
+  };
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef MOCK_IPADDRESS_H
+  #define MOCK_IPADDRESS_H
+
+  #include <Arduino.h>
+
+  class IPAddress {
+  public:
+    IPAddress(uint32_t address=0):m_address(address){}
+
+    //dotted quad only
+    bool fromString(const char *s){
+      unsigned a, b, c, d;
+      char end;
+      if(sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end)!=4 || a>255 || b>255 || c>255 || d>255)
+        return false;
+      m_address= a | (b<<8) | (c<<16) | (d<<24);
+      return true;
+    }
+
+    operator uint32_t() const { return m_address; }
+
+  protected:
+    uint32_t m_address;
+  };
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef MOCK_LITTLEFS_H
+  #define MOCK_LITTLEFS_H
+
+  #include <Arduino.h>
+  #include <map>
+  #include <memory>
+
+  //thrown by the write step a test cut the power at
+  struct PowerCut {};
+
+  class FS;
+
+  struct FSInfo {
+    size_t totalBytes;
+    size_t usedBytes;
+    size_t blockSize;
+    size_t pageSize;
+    size_t maxOpenFiles;
+    size_t maxPathLength;
+  };
+
+  //a file system in memory that commits like LittleFS: what is written to a
+  //file becomes visible when it is closed, a rename replaces the target in one step
+  class File {
+  public:
+    File(){}
+    File(FS *fs, const std::string &name, bool write);
+
+    operator bool() const { return m_open!=nullptr; }
+
+    size_t size() const { return m_open->data.size(); }
+
+    size_t read(uint8_t *buffer, size_t size){
+      size_t n= m_open->data.size()-m_open->pos;
+      n= (n<size ? n : size);
+      memcpy(buffer, m_open->data.data()+m_open->pos, n);
+      m_open->pos+= n;
+      return n;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size);
+    void close();
+
+  protected:
+    struct Open {
+      FS *fs;
+      std::string name;
+      std::string data;
+      size_t pos= 0;
+      bool write;
+    };
+    std::shared_ptr<Open> m_open;
+  };
+
+  class FS {
+  public:
+    bool begin(){ return true; }
+
+    bool info(FSInfo &info) const {
+      info= FSInfo{1<<20, 0, 8192, 256, 5, 32};
+      return true;
+    }
+
+    bool exists(const char *name) const { return files.count(name)>0; }
+
+    File open(const char *name, const char *mode){
+      bool write= (mode[0]=='w');
+      if(!write && !exists(name))
+        return File();
+      if(write){
+        step();
+        files[name];        // the entry exists right away, empty until the file is closed
+      }
+      return File(this, name, write);
+    }
+
+    bool rename(const char *from, const char *to){
+      step();
+      if(!exists(from))
+        return false;
+      files[to]= files[from];
+      files.erase(from);
+      return true;
+    }
+
+    bool remove(const char *name){
+      step();
+      return files.erase(name)>0;
+    }
+
+    //cut the power at the nth write step from now on (open for writing, write,
+    //close, rename, remove), the files stay as they were before that step. 0 never
+    void cutPowerAt(unsigned step){ m_cut= step; }
+
+    //called before every write step
+    void step(){
+      steps++;
+      if(m_cut && --m_cut==0)
+        throw PowerCut();
+    }
+
+    //the content of every file by name
+    std::map<std::string, std::string> files;
+    unsigned steps= 0;
+
+  protected:
+    unsigned m_cut= 0;
+  };
+
+  inline File::File(FS *fs, const std::string &name, bool write):m_open(std::make_shared<Open>()){
+    m_open->fs= fs;
+    m_open->name= name;
+    m_open->write= write;
+    if(!write)
+      m_open->data= fs->files[name];
+  }
+
+  inline size_t File::write(const uint8_t *buffer, size_t size){
+    m_open->fs->step();
+    m_open->data.append((const char*)buffer, size);
+    return size;
+  }
+
+  inline void File::close(){
+    if(m_open && m_open->write){
+      m_open->fs->step();
+      m_open->fs->files[m_open->name]= m_open->data;
+    }
+    m_open= nullptr;
+  }
+
+  inline FS LittleFS;
+
+#endif
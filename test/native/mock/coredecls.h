@@ -0,0 +1,14 @@
+#ifndef MOCK_COREDECLS_H
+  #define MOCK_COREDECLS_H
+
+  #include <Arduino.h>
+  #include <functional>
+
+  //waits up to ms while blocked() holds, checking it every intvl ms
+  inline void esp_delay(unsigned long ms, const std::function<bool()> &blocked, unsigned long intvl){
+    uint32_t start= millis();
+    while(millis()-start<ms && blocked())
+      delay(intvl<ms-(millis()-start) ? intvl : ms-(millis()-start));
+  }
+
+#endif
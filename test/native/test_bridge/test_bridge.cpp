@@ -0,0 +1,361 @@
+//full-duplex traffic through the bridge on the host: the G850 and a network
+//client send at the same time and everything has to arrive, in order and complete
+#include <unity.h>
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "Bridge.h"
+
+//provided by main on the device
+void PrintStats(Print &p){}
+void PrintBootStats(Print &p){}
+bool ApplyConfiguration(const ConfigDigest &previous){ return false; }
+
+//the software serial port: bytes come in at the baud rate into an RX buffer
+//of SoftwareSerial's size, anything beyond is lost. writing blocks for the
+//time the bytes take on the line, like SoftwareSerial::write() does
+class SerialLine : public Stream {
+public:
+  static constexpr size_t RxSize= 256;
+  static constexpr uint32_t CharTime= 1000000UL*10/9600;
+
+  //what the G850 sends, going out at the line speed
+  void send(const std::string &data){
+    m_pending= data;
+    m_sent= 0;
+    m_start= micros();
+  }
+
+  //move the bytes that arrived meanwhile into the RX buffer
+  void receive(){
+    size_t due= (micros()-m_start)/CharTime;
+    due= (due<m_pending.size() ? due : m_pending.size());
+    for(; m_sent<due; m_sent++){
+      if(m_rx.size()<RxSize)
+        m_rx.push_back(m_pending[m_sent]);
+      else
+        lost++;
+    }
+  }
+
+  bool done() const { return m_sent==m_pending.size() && m_rx.empty(); }
+
+  int available() override { receive(); return m_rx.size(); }
+  int read() override {
+    receive();
+    if(m_rx.empty())
+      return -1;
+    int c= m_rx.front();
+    m_rx.pop_front();
+    return c;
+  }
+  int peek() override { return (m_rx.empty() ? -1 : m_rx.front()); }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    out.append((const char*)buffer, size);
+    mock::advance(size*CharTime);
+    return size;
+  }
+  using Print::write;
+
+  std::string out;        // what the G850 got
+  size_t lost= 0;         // RX buffer overruns
+
+protected:
+  std::deque<uint8_t> m_rx;
+  std::string m_pending;
+  size_t m_sent= 0;
+  uint32_t m_start= 0;
+};
+
+void sleepRoutine(){}
+
+//printable payload without '+', so no escape sequence shows up by chance
+std::string payload(size_t size, uint32_t seed){
+  std::string s;
+  for(size_t n=0; n<size; n++){
+    seed= seed*1103515245+12345;
+    char c= ' '+(seed>>16)%95;
+    s+= (c=='+' ? '\n' : c);
+  }
+  return s;
+}
+
+struct Rig {
+  WiFiServer server{23};
+  WiFiClient client;
+  SerialLine serial;
+  Sessions sessions{server, client};
+  ATScanner serialscanner{serial, sleepRoutine};
+  ATScanner netscanner{client, sleepRoutine};
+  Bridge bridge{serial, client, sessions, serialscanner, netscanner};
+
+  Rig(){
+    bridge.baudrate(9600);
+    bridge.coalesce(3, 256);
+    bridge.guardTime(1000);
+  }
+
+  //a client connects
+  std::shared_ptr<Socket> connect(){
+    std::shared_ptr<Socket> socket= server.connect();
+    Sessions::Event event= sessions.poll(millis());
+    if(event==Sessions::WriterStart)
+      bridge.reset();
+    return socket;
+  }
+
+  //the main loop for ms, the peers ack every ackms
+  void run(uint32_t ms, uint32_t ackms, std::initializer_list<Socket*> peers){
+    uint32_t end= millis()+ms;
+    uint32_t ack= millis();
+    while((int32_t)(millis()-end)<0){
+      serial.receive();
+      bridge.service();
+      mock::advance(100);
+      if(millis()-ack>=ackms){
+        for(Socket *peer : peers)
+          peer->ack();
+        ack= millis();
+      }
+    }
+  }
+};
+
+
+void test_full_duplex(){
+  Rig rig;
+  std::shared_ptr<Socket> peer= rig.connect();
+  TEST_ASSERT_TRUE(rig.sessions.writer());
+
+  //a program upload to the G850 while it lists one back, at the same time
+  std::string up= payload(8000, 1);
+  std::string down= payload(8000, 2);
+  peer->window= 536;
+  peer->rx.insert(peer->rx.end(), up.begin(), up.end());
+  rig.serial.send(down);
+
+  rig.run(20000, 20, {peer.get()});
+
+  TEST_ASSERT_EQUAL(0, rig.serial.lost);
+  TEST_ASSERT_TRUE(rig.serial.done());
+  TEST_ASSERT_EQUAL(up.size(), rig.serial.out.size());
+  TEST_ASSERT_TRUE(up==rig.serial.out);
+  TEST_ASSERT_EQUAL(down.size(), peer->tx.size());
+  TEST_ASSERT_TRUE(down==peer->tx);
+  TEST_ASSERT_EQUAL(up.size(), rig.bridge.toSerialBytes());
+  TEST_ASSERT_EQUAL(down.size(), rig.bridge.toNetBytes());
+}
+
+
+void test_monitor_gets_everything(){
+  Rig rig;
+  std::shared_ptr<Socket> writer= rig.connect();
+  std::shared_ptr<Socket> monitor= rig.connect();
+  TEST_ASSERT_EQUAL(1, rig.sessions.monitors());
+
+  std::string up= payload(2000, 3);
+  std::string down= payload(4000, 4);
+  writer->rx.insert(writer->rx.end(), up.begin(), up.end());
+  monitor->rx.insert(monitor->rx.end(), up.begin(), up.end());   // read-only, dropped
+  rig.serial.send(down);
+
+  rig.run(10000, 20, {writer.get(), monitor.get()});
+
+  TEST_ASSERT_EQUAL(0, rig.serial.lost);
+  TEST_ASSERT_TRUE(up==rig.serial.out);
+  TEST_ASSERT_TRUE(down==writer->tx);
+  TEST_ASSERT_TRUE(down==monitor->tx);
+  TEST_ASSERT_EQUAL(0, rig.sessions.lagged());
+}
+
+
+//nobody takes the held data: the oldest bytes make room, the serial port is
+//still read and "+++AT+CFG=" gets through, monitors see everything meanwhile
+void test_hold_full_ring(){
+  Rig rig;
+  loadDefaultConfiguration(GlobalConfig);
+  rig.bridge.onlineCommands(true);
+  std::shared_ptr<Socket> writer= rig.connect();
+  std::shared_ptr<Socket> monitor= rig.connect();
+  writer->open= false;
+  TEST_ASSERT_EQUAL(Sessions::WriterEnd, rig.sessions.poll(millis()));
+  rig.bridge.hold();
+
+  std::string down= payload(3000, 6);
+  rig.serial.send(down);
+  rig.run(5000, 20, {monitor.get()});
+  TEST_ASSERT_TRUE(rig.serial.done());
+  TEST_ASSERT_EQUAL(0, rig.serial.lost);
+  TEST_ASSERT_TRUE(down==monitor->tx);
+  TEST_ASSERT_EQUAL(0, rig.sessions.lagged());
+  size_t held= rig.bridge.held();
+  TEST_ASSERT_GREATER_THAN(BRIDGE_BUFFER_SIZE-BRIDGE_SLICE-4, held);
+  TEST_ASSERT_EQUAL(down.size()-held, rig.bridge.heldDropped());
+
+  //after the guard time
+  rig.serial.send("+++AT+CFG={\"gap\":7}\r\n");
+  rig.run(1000, 20, {monitor.get()});
+  TEST_ASSERT_TRUE(rig.serial.done());
+  TEST_ASSERT_EQUAL(7, GlobalConfig.coalescegap);
+  TEST_ASSERT_TRUE(down==monitor->tx);
+
+  //the next writer gets the newest bytes
+  std::shared_ptr<Socket> next= rig.connect();
+  TEST_ASSERT_TRUE(rig.sessions.writer());
+  rig.run(1000, 20, {next.get(), monitor.get()});
+  TEST_ASSERT_TRUE(down.substr(down.size()-held)==next->tx);
+  TEST_ASSERT_EQUAL(0, rig.bridge.held());
+}
+
+
+//held after a wake up, but nobody comes: the data goes after the hold time
+void test_hold_time(){
+  Rig rig;
+  rig.bridge.hold(2000);
+  rig.serial.send(payload(500, 7));
+  rig.run(1000, 20, {});
+  TEST_ASSERT_EQUAL(500, rig.bridge.held());
+
+  rig.run(1500, 20, {});
+  TEST_ASSERT_EQUAL(0, rig.bridge.held());
+  TEST_ASSERT_EQUAL(0, rig.bridge.heldDropped());
+
+  //a client connecting later starts with what comes next
+  rig.serial.send("10 PRINT");
+  std::shared_ptr<Socket> peer= rig.connect();
+  rig.run(100, 20, {peer.get()});
+  TEST_ASSERT_TRUE(peer->tx=="10 PRINT");
+}
+
+//an AT answer for the G850 queues behind the upload towards it and goes out
+//paced like it, instead of blocking the bridge for its whole length while
+//there is room in the ring
+void test_answer_paced(){
+  struct Text : Print {
+    size_t write(uint8_t c) override { text+= (char)c; return 1; }
+    using Print::write;
+    std::string text;
+  } answer;
+  loadDefaultConfiguration(GlobalConfig);
+  PrintConfig(answer, "+++AT+CFG=");
+  answer.println("OK");
+
+  Rig rig;
+  rig.bridge.onlineCommands(true);
+  std::shared_ptr<Socket> peer= rig.connect();
+  rig.run(1500, 20, {peer.get()});
+
+  std::string up= payload(500, 8);
+  peer->rx.insert(peer->rx.end(), up.begin(), up.end());
+  rig.run(100, 20, {peer.get()});
+  rig.serial.send("+++AT+CFG?\r\n");
+  uint32_t longest= 0;
+  uint32_t end= millis()+5000;
+  while((int32_t)(millis()-end)<0){
+    rig.serial.receive();
+    uint32_t start= micros();
+    rig.bridge.service();
+    longest= (micros()-start>longest ? micros()-start : longest);
+    mock::advance(100);
+    peer->ack();
+  }
+
+  size_t at= rig.serial.out.find(answer.text);
+  TEST_ASSERT_TRUE(at!=std::string::npos);
+  TEST_ASSERT_TRUE(up==rig.serial.out.substr(0, at)+rig.serial.out.substr(at+answer.text.size()));
+  TEST_ASSERT_EQUAL(up.size()+answer.text.size(), rig.bridge.toSerialBytes());
+  TEST_ASSERT_LESS_OR_EQUAL(SERIAL_TX_SLICE_US+2*SerialLine::CharTime, longest);
+}
+
+
+//without online commands "+++AT..." needs the guard time after "+++", sent in
+//one go after a pause it is data, e.g. from a binary file
+void test_online_commands(){
+  Rig rig;
+  loadDefaultConfiguration(GlobalConfig);
+  std::shared_ptr<Socket> peer= rig.connect();
+  rig.run(1500, 20, {peer.get()});
+
+  std::string line= "+++AT+CFG={\"gap\":7}\r\n";
+  rig.serial.send(line);
+  rig.run(1500, 20, {peer.get()});
+  TEST_ASSERT_TRUE(line==peer->tx);
+  TEST_ASSERT_EQUAL(COALESCEGAP, GlobalConfig.coalescegap);
+
+  rig.bridge.onlineCommands(true);
+  rig.serial.send(line);
+  rig.run(1500, 20, {peer.get()});
+  TEST_ASSERT_TRUE(line==peer->tx);
+  TEST_ASSERT_EQUAL(7, GlobalConfig.coalescegap);
+}
+
+//a monitor connecting to an idle writer doesn't take its session by default,
+//only with a takeover time
+void test_idle_writer_kept(){
+  Rig rig;
+  std::shared_ptr<Socket> writer= rig.connect();
+  delay(600000);
+  std::shared_ptr<Socket> monitor= rig.server.connect();
+  TEST_ASSERT_EQUAL(Sessions::MonitorStart, rig.sessions.poll(millis()));
+  TEST_ASSERT_TRUE(writer->open);
+  TEST_ASSERT_EQUAL(0, rig.sessions.takeovers());
+
+  rig.sessions.takeover(10);
+  std::shared_ptr<Socket> next= rig.server.connect();
+  TEST_ASSERT_EQUAL(Sessions::Takeover, rig.sessions.poll(millis()));
+  TEST_ASSERT_FALSE(writer->open);
+  TEST_ASSERT_EQUAL(1, rig.sessions.takeovers());
+}
+
+//the send buffer statistics count bytes, every byte once
+void test_tcp_stats(){
+  WiFiServer server(23);
+  WiFiClient client;
+  Sessions sessions(server, client);
+  RingBuffer<1024> ring;
+  std::shared_ptr<Socket> peer= server.connect();
+  sessions.poll(millis());
+  peer->window= 300;
+
+  //wraps around the end of the ring, still goes out in one pass
+  std::string skip(900, 'x');
+  ring.push((const uint8_t*)skip.data(), skip.size());
+  ring.consume(skip.size());
+  sessions.seek(ring.head());
+  sessions.send(ring, ring.head(), 0);
+  std::string data= payload(250, 5);
+  ring.push((const uint8_t*)data.data(), data.size());
+  TEST_ASSERT_EQUAL(250, sessions.send(ring, ring.head(), 0));
+  TEST_ASSERT_EQUAL(0, sessions.deferred());
+
+  //50 bytes room left, the rest waits and is counted once
+  ring.push((const uint8_t*)data.data(), data.size());
+  TEST_ASSERT_EQUAL(50, sessions.send(ring, ring.head(), 0));
+  TEST_ASSERT_EQUAL(200, sessions.deferred());
+  TEST_ASSERT_EQUAL(0, sessions.send(ring, ring.head(), 0));
+  TEST_ASSERT_EQUAL(200, sessions.deferred());
+
+  peer->ack();
+  TEST_ASSERT_EQUAL(200, sessions.send(ring, ring.head(), 0));
+  TEST_ASSERT_EQUAL(200, sessions.deferred());
+  TEST_ASSERT_EQUAL(0, sessions.partial());
+  TEST_ASSERT_TRUE(data+data==peer->tx);
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_full_duplex);
+  RUN_TEST(test_monitor_gets_everything);
+  RUN_TEST(test_hold_full_ring);
+  RUN_TEST(test_hold_time);
+  RUN_TEST(test_online_commands);
+  RUN_TEST(test_answer_paced);
+  RUN_TEST(test_idle_writer_kept);
+  RUN_TEST(test_tcp_stats);
+  return UNITY_END();
+}
@@ -0,0 +1,136 @@
+//AT command dispatch through the command table: the automaton against strstr()
+//over random lines, and lines fed through the scanner reaching their handlers
+#include <unity.h>
+#include <Arduino.h>
+#include "ATScanner.h"
+
+unsigned statsPrinted= 0;
+unsigned applied= 0;
+bool restart= false;
+
+void PrintStats(Print &p){ statsPrinted++; }
+void PrintBootStats(Print &p){}
+bool ApplyConfiguration(const ConfigDigest &previous){
+  applied++;
+  restart= (previous.restart!=configDigest(GlobalConfig).restart);
+  return false;
+}
+
+class Output : public Print {
+public:
+  size_t write(uint8_t c) override { text+= (char)c; return 1; }
+  using Print::write;
+  std::string text;
+};
+
+unsigned slept= 0;
+void sleepRoutine(){ slept++; }
+
+//feed a line to the scanner the way the bridge does, in pieces
+void scanLine(ATScanner &scanner, const std::string &line){
+  std::string text= line+"\r\n";
+  for(size_t n=0; n<text.size(); n+= 5)
+    scanner.scan((const uint8_t*)text.data()+n, (text.size()-n<5 ? text.size()-n : 5));
+}
+
+
+void test_automaton_matches_strstr(){
+  //few characters, so prefixes and near misses show up often
+  const char chars[]= "AT+CFGSVELP?=!OD";
+  uint32_t seed= 1;
+  for(int round=0; round<20000; round++){
+    char line[48];
+    size_t len= 1+round%(sizeof(line)-1);
+    for(size_t n=0; n<len; n++){
+      seed= seed*1103515245+12345;
+      line[n]= chars[(seed>>16)%(sizeof(chars)-1)];
+    }
+    line[len]= 0x0;
+
+    uint32_t expected= 0;
+    for(size_t i=0; i<ATCommandCount; i++)
+      if(strstr(line, ATCommands[i].prefix))
+        expected|= (1UL<<i);
+
+    uint8_t state= ATCommandMatcher.Root;
+    uint32_t found= 0;
+    for(size_t n=0; n<len; n++){
+      state= ATCommandMatcher.step(state, line[n]);
+      found|= ATCommandMatcher.matches(state);
+    }
+    TEST_ASSERT_EQUAL(expected, found);
+  }
+}
+
+
+void test_dispatch(){
+  Output out;
+  ATScanner scanner(out, sleepRoutine);
+  loadDefaultConfiguration(GlobalConfig);
+
+  scanLine(scanner, "+++AT+STAT?");
+  TEST_ASSERT_EQUAL(1, statsPrinted);
+  TEST_ASSERT_TRUE(out.text=="OK\r\n");
+
+  //no command, nothing happens
+  out.text.clear();
+  scanLine(scanner, "10 PRINT \"AT+\";A");
+  TEST_ASSERT_TRUE(out.text.empty());
+
+  //the handler gets the text behind its own prefix
+  scanLine(scanner, "+++AT+CFG={\"gap\":7,\"ssid\":\"LAB\"}");
+  TEST_ASSERT_EQUAL(7, GlobalConfig.coalescegap);
+  TEST_ASSERT_EQUAL_STRING("LAB", GlobalConfig.wifissid);
+  TEST_ASSERT_EQUAL(1, applied);
+  TEST_ASSERT_TRUE(restart);      // new ssid
+
+  scanLine(scanner, "+++AT+CFG={\"gap\":3}");
+  TEST_ASSERT_EQUAL(2, applied);
+  TEST_ASSERT_FALSE(restart);
+
+  //several commands in one line run in table order, the statistics before sleep
+  out.text.clear();
+  scanLine(scanner, "AT+SLEEP AT+STAT?");
+  TEST_ASSERT_EQUAL(2, statsPrinted);
+  TEST_ASSERT_EQUAL(1, slept);
+  TEST_ASSERT_TRUE(out.text=="OK\r\nOK");
+}
+
+
+void test_longest_configuration(){
+  Output out;
+  ATScanner scanner(out, sleepRoutine);
+  loadDefaultConfiguration(GlobalConfig);
+
+  Config cfg;
+  loadDefaultConfiguration(cfg);
+  memset(cfg.hostname, 'h', sizeof(cfg.hostname)-1);
+  cfg.hostname[sizeof(cfg.hostname)-1]= 0x0;
+  memset(cfg.wifipassword, 'p', sizeof(cfg.wifipassword)-1);
+  cfg.wifipassword[sizeof(cfg.wifipassword)-1]= 0x0;
+  memset(cfg.remotehost, 'r', sizeof(cfg.remotehost)-1);
+  cfg.remotehost[sizeof(cfg.remotehost)-1]= 0x0;
+  char json[JSONSIZE];
+  TEST_ASSERT_GREATER_THAN(0, serializeConfiguration(cfg, json, sizeof(json)));
+
+  //set in one line and printed back complete
+  scanLine(scanner, std::string("+++AT+CFG=")+json);
+  TEST_ASSERT_EQUAL_STRING(cfg.hostname, GlobalConfig.hostname);
+  TEST_ASSERT_EQUAL_STRING(cfg.remotehost, GlobalConfig.remotehost);
+
+  out.text.clear();
+  scanLine(scanner, "+++AT+CFG?");
+  TEST_ASSERT_TRUE(out.text==std::string("+++AT+CFG=")+json+"\r\nOK\r\n");
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_automaton_matches_strstr);
+  RUN_TEST(test_dispatch);
+  RUN_TEST(test_longest_configuration);
+  return UNITY_END();
+}
@@ -0,0 +1,282 @@
+//the configuration file: a power cut at any step of the write leaves either
+//the old or the new config.ini, and the next save gets through. a file
+//written by hand loads no matter how it is laid out, one that can't be used
+//is never overwritten
+#include <unity.h>
+#include <Arduino.h>
+#include "config.h"
+
+//the file as it is written for a configuration
+std::string json(const Config &cfg){
+  char buf[JSONSIZE];
+  size_t len= serializeConfiguration(cfg, buf, sizeof(buf));
+  return std::string(buf, len);
+}
+
+//what the adapter loads after the reboot
+std::string reboot(){
+  LittleFS.cutPowerAt(0);
+  Config cfg;
+  readConfigurationFromFile(cfg, CONFIGFILENAME);
+  return json(cfg);
+}
+
+const std::string *file(const char *name){
+  auto f= LittleFS.files.find(name);
+  return (f==LittleFS.files.end() ? nullptr : &f->second);
+}
+
+Config configuration(const char *ssid, int gap){
+  Config cfg;
+  loadDefaultConfiguration(cfg);
+  strlcpy(cfg.wifissid, ssid, sizeof(cfg.wifissid));
+  strlcpy(cfg.wifipassword, "secret", sizeof(cfg.wifipassword));
+  cfg.coalescegap= gap;
+  return cfg;
+}
+
+
+void test_power_cut_replacing_file(){
+  Config before= configuration("OLD", 3);
+  Config after= configuration("NEW", 9);
+
+  unsigned cut;
+  bool finished= false;
+  for(cut=1; !finished; cut++){
+    LittleFS.files.clear();
+    LittleFS.cutPowerAt(0);
+    writeConfiguration(before, CONFIGFILENAME);
+
+    LittleFS.cutPowerAt(cut);
+    try {
+      writeConfiguration(after, CONFIGFILENAME);
+      finished= true;
+    } catch(PowerCut &) {}
+
+    const std::string *ini= file(CONFIGFILENAME);
+    TEST_ASSERT_NOT_NULL(ini);
+    TEST_ASSERT_TRUE(*ini==json(before) || *ini==json(after));
+    std::string loaded= reboot();
+    TEST_ASSERT_TRUE(loaded==json(before) || loaded==json(after));
+    TEST_ASSERT_TRUE(!finished || *file(CONFIGFILENAME)==json(after));
+
+    //a temporary file left behind doesn't get in the way
+    writeConfiguration(after, CONFIGFILENAME);
+    TEST_ASSERT_TRUE(*file(CONFIGFILENAME)==json(after));
+  }
+  //open, write, close and rename were all hit
+  TEST_ASSERT_GREATER_OR_EQUAL(4, cut-1);
+}
+
+
+void test_power_cut_first_save(){
+  Config after= configuration("NEW", 9);
+
+  bool finished= false;
+  for(unsigned cut=1; !finished; cut++){
+    LittleFS.files.clear();
+    LittleFS.cutPowerAt(cut);
+    try {
+      writeConfiguration(after, CONFIGFILENAME);
+      finished= true;
+    } catch(PowerCut &) {}
+
+    //no file at all or the complete one, never an empty or partial config.ini
+    const std::string *ini= file(CONFIGFILENAME);
+    TEST_ASSERT_TRUE(ini==nullptr || *ini==json(after));
+    TEST_ASSERT_TRUE(!finished || ini!=nullptr);
+  }
+}
+
+
+void test_unchanged_not_written(){
+  Config cfg= configuration("SAME", 3);
+  LittleFS.files.clear();
+  LittleFS.cutPowerAt(0);
+  writeConfiguration(cfg, CONFIGFILENAME);
+  unsigned steps= LittleFS.steps;
+  uint32_t skipped= ConfigFileStats.skipped;
+
+  writeConfiguration(cfg, CONFIGFILENAME);
+  TEST_ASSERT_EQUAL(steps, LittleFS.steps);
+  TEST_ASSERT_EQUAL(skipped+1, ConfigFileStats.skipped);
+}
+
+
+//a write erases a block for the content and one for the directory, the
+//estimate lives on in the snapshot across reboots
+void test_erases_kept(){
+  LittleFS.files.clear();
+  LittleFS.cutPowerAt(0);
+  uint32_t erases= ConfigFileStats.erases;
+  saveConfiguration(configuration("WEAR", 4));
+  TEST_ASSERT_EQUAL(erases+2, ConfigFileStats.erases);
+
+  ConfigFileStats= StorageStats();                // reboot
+  Config cfg;
+  TEST_ASSERT_TRUE(readConfigurationSnapshot(cfg));
+  TEST_ASSERT_EQUAL(erases+2, ConfigFileStats.erases);
+}
+
+
+//the configuration with every item at its widest
+Config longest(){
+  Config cfg;
+  #define CONFIG_INT_LONGEST(name, tag, def, lo, hi)         cfg.name= (hi);
+  #define CONFIG_STR_LONGEST(name, tag, def, size, valid)    memset(cfg.name, 'x', (size)-1); cfg.name[(size)-1]= 0x0;
+  CONFIG_ITEMS(CONFIG_INT_LONGEST, CONFIG_STR_LONGEST)
+  strlcpy(cfg.staticip, "192.168.100.200", sizeof(cfg.staticip));
+  strlcpy(cfg.staticgateway, "192.168.100.254", sizeof(cfg.staticgateway));
+  strlcpy(cfg.staticmask, "255.255.255.255", sizeof(cfg.staticmask));
+  strlcpy(cfg.staticdns, "192.168.100.253", sizeof(cfg.staticdns));
+  return cfg;
+}
+
+
+void test_longest_saved(){
+  Config cfg= longest();
+  std::string text= json(cfg);
+  TEST_ASSERT_GREATER_THAN(0, text.size());
+  TEST_ASSERT_LESS_THAN(JSONSIZE, text.size()+1);
+
+  LittleFS.files.clear();
+  writeConfiguration(cfg, CONFIGFILENAME);
+  TEST_ASSERT_TRUE(LittleFS.files[CONFIGFILENAME]==text);
+
+  Config loaded;
+  loadDefaultConfiguration(loaded);
+  TEST_ASSERT_TRUE(readConfigurationFromJson(loaded, text.c_str()));
+  TEST_ASSERT_EQUAL_STRING(cfg.hostname, loaded.hostname);
+  TEST_ASSERT_EQUAL_STRING(cfg.remotehost, loaded.remotehost);
+  TEST_ASSERT_EQUAL(cfg.keepalive, loaded.keepalive);
+}
+
+
+//a configuration as it is in use
+Config realistic(){
+  Config cfg= configuration("FRITZ!Box 7590 XY", 3);
+  strlcpy(cfg.wifipassword, "correct horse battery staple", sizeof(cfg.wifipassword));
+  strlcpy(cfg.remotehost, "archive.example.org", sizeof(cfg.remotehost));
+  strlcpy(cfg.staticip, "192.168.178.50", sizeof(cfg.staticip));
+  strlcpy(cfg.staticgateway, "192.168.178.1", sizeof(cfg.staticgateway));
+  strlcpy(cfg.staticmask, "255.255.255.0", sizeof(cfg.staticmask));
+  strlcpy(cfg.staticdns, "192.168.178.1", sizeof(cfg.staticdns));
+  return cfg;
+}
+
+std::string pretty(const Config &cfg){
+  DynamicJsonDocument doc(4096);
+  deserializeJson(doc, json(cfg));
+  std::string text;
+  serializeJsonPretty(doc, text);
+  return text;
+}
+
+
+void test_pretty_file_loads(){
+  Config cfg= realistic();
+  std::string text= pretty(cfg);
+  LittleFS.files.clear();
+  LittleFS.files[CONFIGFILENAME]= text;
+
+  Config loaded;
+  TEST_ASSERT_TRUE(readConfigurationFromFile(loaded, CONFIGFILENAME));
+  TEST_ASSERT_TRUE(json(loaded)==json(cfg));
+  TEST_ASSERT_TRUE(LittleFS.files[CONFIGFILENAME]==text);
+}
+
+
+void test_long_pretty_file_loads(){
+  Config cfg= longest();
+  std::string text= pretty(cfg);
+  TEST_ASSERT_GREATER_THAN(JSONSIZE, text.size());
+  LittleFS.files.clear();
+  LittleFS.files[CONFIGFILENAME]= text;
+
+  Config loaded;
+  TEST_ASSERT_TRUE(readConfigurationFromFile(loaded, CONFIGFILENAME));
+  TEST_ASSERT_TRUE(json(loaded)==json(cfg));
+}
+
+
+void test_unusable_file_kept(){
+  const char *broken[]= {
+    "{\"ssid\":\"HOME\",\"wifipw\":\"secret\"",               // cut off
+    "{\"ssid\":\"HOME\", \"gap\":1 2}",                      // white space between two values
+    "{\"ssid\":\"HOME\",\"notes\":\"%s\"}"                     // too long for the buffer
+  };
+  std::string notes(2*JSONSIZE, 'n');
+  for(const char *format : broken){
+    char text[4*JSONSIZE];
+    snprintf(text, sizeof(text), format, notes.c_str());
+    LittleFS.files.clear();
+    LittleFS.files[CONFIGFILENAME]= text;
+    EEPROM.begin(sizeof(ConfigSnapshot));
+    memset(EEPROM.getDataPtr(), 0, sizeof(ConfigSnapshot));
+    EEPROM.commit();
+    unsigned commits= EEPROM.commits;
+
+    Config cfg, defaults;
+    loadDefaultConfiguration(defaults);
+    loadConfiguration(cfg);
+    TEST_ASSERT_TRUE(json(cfg)==json(defaults));
+    TEST_ASSERT_TRUE(LittleFS.files[CONFIGFILENAME]==text);
+    TEST_ASSERT_EQUAL(1, LittleFS.files.size());
+    TEST_ASSERT_EQUAL(commits, EEPROM.commits);     // no snapshot, the next boot tries the file again
+  }
+}
+
+
+//the snapshot wins over a config.ini uploaded later, unless it was written
+//by firmware with other defaults
+void test_snapshot_defaults(){
+  LittleFS.files.clear();
+  LittleFS.cutPowerAt(0);
+  Config cfg;
+  loadDefaultConfiguration(cfg);
+  cfg.coalescegap= 7;
+  saveConfiguration(cfg);
+  LittleFS.files[CONFIGFILENAME]= "{\"gap\":5}";
+
+  loadConfiguration(cfg);
+  TEST_ASSERT_EQUAL(7, cfg.coalescegap);
+
+  EEPROM.begin(sizeof(ConfigSnapshot));
+  ConfigSnapshot *snap= (ConfigSnapshot*)EEPROM.getDataPtr();
+  snap->defaults^= 1;
+  snap->crc= crc32((const uint8_t*)snap, offsetof(ConfigSnapshot, crc));
+  EEPROM.commit();
+  loadConfiguration(cfg);
+  TEST_ASSERT_EQUAL(5, cfg.coalescegap);
+  TEST_ASSERT_TRUE(readConfigurationSnapshot(cfg));      // and the new one is kept
+  TEST_ASSERT_EQUAL(5, cfg.coalescegap);
+}
+
+
+void test_missing_file_created(){
+  LittleFS.files.clear();
+  Config cfg, defaults;
+  loadDefaultConfiguration(defaults);
+  TEST_ASSERT_TRUE(readConfigurationFromFile(cfg, CONFIGFILENAME));
+  TEST_ASSERT_TRUE(json(cfg)==json(defaults));
+  TEST_ASSERT_TRUE(LittleFS.files[CONFIGFILENAME]==json(defaults));
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_power_cut_replacing_file);
+  RUN_TEST(test_power_cut_first_save);
+  RUN_TEST(test_snapshot_defaults);
+  RUN_TEST(test_erases_kept);
+  RUN_TEST(test_unchanged_not_written);
+  RUN_TEST(test_longest_saved);
+  RUN_TEST(test_pretty_file_loads);
+  RUN_TEST(test_long_pretty_file_loads);
+  RUN_TEST(test_unusable_file_kept);
+  RUN_TEST(test_missing_file_created);
+  return UNITY_END();
+}
@@ -0,0 +1,112 @@
+//JsonReader against ArduinoJson on mutated configuration strings: whatever
+//the reader accepts ArduinoJson has to accept as well, with the same values.
+//build with -fsanitize=address,undefined to catch reads past the text
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "JsonReader.h"
+
+const char *Seeds[]= {
+  "{\"rev\":1,\"sleep\":600,\"baud\":9600,\"port\":23,\"gap\":3,\"chunk\":256,\"guard\":1000,\"ssid\":\"GUEST\",\"wifipw\":\"\",\"host\":\"G850V.local\",\"otapw\":\"myOTAPW\"}",
+  " { \"ssid\" : \"a\\\"b\\\\c\\u00e9\" , \"x\":[1,{\"y\":[true,false,null]},-0.5e3], \"port\": -12.9 } ",
+  "{}",
+  "{\"a\":{}}",
+  "{\"a\":[]}",
+  "{\"baud\":99999999999999}"
+};
+constexpr size_t SeedCount= sizeof(Seeds)/sizeof(Seeds[0]);
+
+//what the mutations are made of
+const char Alphabet[]= "{}[]\",:0123456789-+.eEtrufalsn\\u \tabx";
+
+uint32_t seed= 1;
+uint32_t rnd(uint32_t range){
+  seed= seed*1103515245+12345;
+  return (seed>>16)%range;
+}
+
+std::string mutate(){
+  std::string s= Seeds[rnd(SeedCount)];
+  for(uint32_t n=rnd(4); n>0; n--){
+    size_t pos= (s.empty() ? 0 : rnd(s.size()));
+    char c= Alphabet[rnd(sizeof(Alphabet)-1)];
+    switch(rnd(3)){
+      case 0: if(!s.empty()) s.erase(pos, 1); break;
+      case 1: s.insert(pos, 1, c); break;
+      default: if(!s.empty()) s[pos]= c;
+    }
+  }
+  return s;
+}
+
+//every member the reader reports has the value ArduinoJson found
+void compare(const std::string &s, JsonObject object){
+  JsonReader reader(s.c_str());
+  while(reader.next()){
+    for(JsonPair member : object){
+      if(!reader.key(member.key().c_str()))
+        continue;
+      char text[300];
+      int32_t value;
+      if(reader.string(text, sizeof(text)) && member.value().is<const char*>())
+        TEST_ASSERT_EQUAL_STRING(member.value().as<const char*>(), text);
+      if(reader.integer(value) && member.value().is<long>() && labs(member.value().as<long>())<2147483647L)
+        TEST_ASSERT_EQUAL(member.value().as<long>(), value);
+    }
+  }
+}
+
+
+void test_differential_fuzz(){
+  unsigned valid= 0;
+  for(int round=0; round<200000; round++){
+    std::string s= mutate();
+
+    JsonReader reader(s.c_str());
+    while(reader.next()){
+      int32_t value;
+      char text[8];
+      reader.integer(value);
+      reader.string(text, sizeof(text));
+    }
+
+    StaticJsonDocument<2048> doc;
+    DeserializationError error= deserializeJson(doc, s.c_str(), DeserializationOption::NestingLimit(JSONREADER_DEPTH+1));
+    //ArduinoJson is the more lenient one (comments, single quotes), so only one way round
+    if(!reader.error()){
+      valid++;
+      TEST_ASSERT_TRUE_MESSAGE(!error && doc.is<JsonObject>(), s.c_str());
+      compare(s, doc.as<JsonObject>());
+    }
+  }
+  //enough of the mutants were well formed to compare values
+  TEST_ASSERT_GREATER_THAN(10000, valid);
+}
+
+
+void test_strict(){
+  const char *rejected[]= {
+    "{'ssid':'GUEST'}",
+    "{\"gap\":3 /* idle */}",
+    "{\"gap\":3,}",
+    "{\"gap\":01}",
+    "{\"gap\":3} x",
+    "{\"gap\":[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]}"
+  };
+  for(const char *s : rejected){
+    JsonReader reader(s);
+    while(reader.next());
+    TEST_ASSERT_TRUE_MESSAGE(reader.error(), s);
+  }
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_differential_fuzz);
+  RUN_TEST(test_strict);
+  return UNITY_END();
+}
@@ -0,0 +1,120 @@
+//the command automaton against the substring search it replaced, on BASIC
+//listings: both have to find the same commands, the automaton in one pass
+#include <unity.h>
+#include <Arduino.h>
+#include <chrono>
+#include "ATScanner.h"
+
+void PrintStats(Print &p){}
+void PrintBootStats(Print &p){}
+bool ApplyConfiguration(const ConfigDigest &previous){ return false; }
+
+//the search the scanner used before, once per command and line
+int findPattern(const char *pat, const char *txt){
+  int patLen = strlen(pat);
+  int txtLen = strlen(txt);
+  if(patLen>txtLen)
+    return -1;
+
+  int srchLen= txtLen-patLen;
+  for(int t=0;t<=srchLen;t++){
+    for(int p=0;p<patLen;p++){
+      if((pat[p]==txt[t+p])){
+        if(p==(patLen-1))
+          return t;
+      }
+      else{
+        break;
+      }
+    }
+  }
+  return -1;
+}
+
+const char *Listing[]= {
+  "10 REM ** LUNAR LANDER **",
+  "20 CLEAR :DIM A$(3)*16",
+  "30 H=1000:V=-50:F=150:T=0",
+  "40 PRINT \"ALT\";H;\" VEL\";V;\" FUEL\";F",
+  "50 INPUT \"BURN (0-30)\";B",
+  "60 IF B<0 OR B>30 THEN 50",
+  "70 IF B>F THEN B=F",
+  "80 F=F-B:V=V+B-5:H=H+V:T=T+1",
+  "90 IF H>0 THEN 40",
+  "100 IF V>=-5 THEN PRINT \"LANDED AFTER\";T;\"S\":GOTO 130",
+  "110 PRINT \"CRASHED AT\";ABS V;\"M/S\"",
+  "120 A$(0)=\"+\"+STR$ V+\"/\"+STR$ T",
+  "130 INPUT \"AGAIN (Y/N)\";A$(1)",
+  "140 IF A$(1)=\"Y\" THEN 30",
+  "150 LPRINT \"AT\";T;\"+\";F:END",
+  "200 REM +++ SAVED WITH +++AT+SAVE IN MIND +++",
+  "210 FOR I=0 TO 15:X=X+I*I:NEXT I",
+  "220 PRINT USING \"###.##\";X/7",
+  "230 WAIT 64:BEEP 3",
+  "240 GOSUB 500:RETURN",
+  "+++AT+STAT?",
+  "+++AT+CFG={\"gap\":3,\"chunk\":256}"
+};
+constexpr size_t ListingLines= sizeof(Listing)/sizeof(Listing[0]);
+
+//commands found in a line, as the scanner's bit mask
+uint32_t searchLine(const char *line){
+  uint32_t found= 0;
+  for(size_t i=0; i<ATCommandCount; i++)
+    if(findPattern(ATCommands[i].prefix, line)>=0)
+      found|= (1UL<<i);
+  return found;
+}
+
+uint32_t matchLine(const char *line){
+  uint8_t state= ATCommandMatcher.Root;
+  uint32_t found= 0;
+  for(const char *c= line; *c; c++){
+    state= ATCommandMatcher.step(state, *c);
+    found|= ATCommandMatcher.matches(state);
+  }
+  return found;
+}
+
+
+void test_same_commands_found(){
+  for(size_t n=0; n<ListingLines; n++)
+    TEST_ASSERT_EQUAL(searchLine(Listing[n]), matchLine(Listing[n]));
+  TEST_ASSERT_TRUE(matchLine("+++AT+STAT?")!=0);
+  TEST_ASSERT_TRUE(matchLine("20 CLEAR :DIM A$(3)*16")==0);
+}
+
+
+template <class Scan>
+double nsPerLine(Scan scan, volatile uint32_t &sink){
+  const int rounds= 20000;
+  auto start= std::chrono::steady_clock::now();
+  for(int r=0; r<rounds; r++)
+    for(size_t n=0; n<ListingLines; n++)
+      sink+= scan(Listing[n]);
+  auto end= std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end-start).count()/(rounds*ListingLines);
+}
+
+//the timings are only reported, they depend on the machine and its load
+void test_benchmark(){
+  volatile uint32_t searched= 0, matched= 0;
+  double search= nsPerLine(searchLine, searched);
+  double match= nsPerLine(matchLine, matched);
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "findPattern %.1f ns/line, automaton %.1f ns/line, %zu commands", search, match, ATCommandCount);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL(searched, matched);
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_same_commands_found);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,185 @@
+//the timer wheel: random one-shot timers never fire early and at most a tick
+//late, also across the millis() wrap, periodic timers keep their rate, and
+//the idle wait ends on I/O
+#include <unity.h>
+#include <Arduino.h>
+#include "Scheduler.h"
+
+const int TimerCount= 8;
+
+struct Expected {
+  uint32_t deadline;
+  uint32_t fired;           // millis() it fired, 0 not yet
+  bool due;
+};
+Expected expected[TimerCount];
+
+template <int N>
+void fire(){ expected[N].fired= millis(); expected[N].due= true; }
+
+Timer::Callback callbacks[TimerCount]= {fire<0>, fire<1>, fire<2>, fire<3>, fire<4>, fire<5>, fire<6>, fire<7>};
+
+uint32_t seed= 3;
+uint32_t rnd(uint32_t range){
+  seed= seed*1103515245+12345;
+  return (seed>>16)%range;
+}
+
+void oneShots(uint32_t start){
+  mock::setMillis(start);
+  Scheduler scheduler;
+  Timer *timers[TimerCount];
+  for(int n=0; n<TimerCount; n++){
+    timers[n]= new Timer(scheduler, callbacks[n]);
+    expected[n].due= false;
+  }
+
+  unsigned fired= 0;
+  for(int round=0; round<20000; round++){
+    int n= rnd(TimerCount);
+    if(!timers[n]->armed()){
+      uint32_t delay= rnd(2000);
+      expected[n].deadline= millis()+delay;
+      timers[n]->start(delay);
+    }
+    uint32_t wait= scheduler.nextDue(rnd(50)+1);
+    delay(wait ? wait : 1);
+    scheduler.run();
+
+    for(int k=0; k<TimerCount; k++){
+      if(!expected[k].due)
+        continue;
+      int32_t late= expected[k].fired-expected[k].deadline;
+      TEST_ASSERT_GREATER_OR_EQUAL(0, late);
+      TEST_ASSERT_LESS_OR_EQUAL(SCHEDULER_TICK, late);
+      expected[k].due= false;
+      fired++;
+    }
+  }
+  TEST_ASSERT_GREATER_THAN(2000, fired);
+
+  //none gets lost
+  delay(2000+SCHEDULER_TICK);
+  scheduler.run();
+  for(int n=0; n<TimerCount; n++){
+    TEST_ASSERT_FALSE(timers[n]->armed());
+    delete timers[n];
+  }
+}
+
+void test_one_shots(){ oneShots(1000); }
+void test_one_shots_across_wrap(){ oneShots(0xFFFFF000UL); }
+
+
+int periodicCount= 0;
+void periodic(){ periodicCount++; }
+
+void test_periodic(){
+  mock::setMillis(5);
+  Scheduler scheduler;
+  //not a multiple of the tick, the rate still holds
+  Timer timer(scheduler, periodic, 25);
+  timer.start();
+  for(int n=0; n<25000+SCHEDULER_TICK; n++){   // runs at the end of its tick
+    delay(1);
+    scheduler.run();
+  }
+  TEST_ASSERT_EQUAL(1000, periodicCount);
+
+  //after a stall it goes on at its rate instead of catching up
+  delay(500);
+  scheduler.run();
+  TEST_ASSERT_EQUAL(1001, periodicCount);
+}
+
+
+//timers due in the same tick that stop or re-arm each other: only the first
+//one runs, the other one does what the first asked for
+Timer *other[2];
+int fired[2];
+
+template <int N>
+void stopOther(){ fired[N]++; other[1-N]->stop(); }
+
+template <int N>
+void restartOther(){ fired[N]++; other[1-N]->start(50); }
+
+void test_due_timers_change_each_other(){
+  mock::setMillis(1000);
+  Scheduler scheduler;
+  Timer a(scheduler, stopOther<0>), b(scheduler, stopOther<1>);
+  other[0]= &a;
+  other[1]= &b;
+  fired[0]= fired[1]= 0;
+  a.start(10);
+  b.start(10);
+  delay(10+SCHEDULER_TICK);
+  scheduler.run();
+  TEST_ASSERT_EQUAL(1, fired[0]+fired[1]);
+  TEST_ASSERT_FALSE(a.armed());
+  TEST_ASSERT_FALSE(b.armed());
+
+  Timer c(scheduler, restartOther<0>), d(scheduler, restartOther<1>);
+  other[0]= &c;
+  other[1]= &d;
+  fired[0]= fired[1]= 0;
+  c.start(10);
+  d.start(10);
+  delay(10+SCHEDULER_TICK);
+  scheduler.run();
+  TEST_ASSERT_EQUAL(1, fired[0]+fired[1]);
+  TEST_ASSERT_TRUE(c.armed()!=d.armed());
+
+  //they take turns every 50 ms, at most a tick late, from then on
+  for(int n=0; n<200; n++){
+    delay(1);
+    scheduler.run();
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(4, fired[0]+fired[1]);
+  TEST_ASSERT_LESS_OR_EQUAL(5, fired[0]+fired[1]);
+  TEST_ASSERT_LESS_OR_EQUAL(1, fired[0]>fired[1] ? fired[0]-fired[1] : fired[1]-fired[0]);
+  c.stop();
+  d.stop();
+}
+
+
+bool io= false;
+bool ready(){ return io; }
+void arrive(){ io= true; }
+
+void test_idle_ends_on_io(){
+  mock::setMillis(100);
+  Scheduler scheduler;
+  Timer timer(scheduler, arrive);
+
+  //nothing to do: waits the whole limit
+  io= false;
+  scheduler.idle(50, ready);
+  TEST_ASSERT_EQUAL(150, millis());
+
+  //a timer is due earlier
+  timer.start(20);
+  scheduler.idle(50, ready);
+  TEST_ASSERT_LESS_OR_EQUAL(150+20+SCHEDULER_TICK, millis());
+  scheduler.run();
+  TEST_ASSERT_TRUE(io);
+
+  //I/O pending: no wait at all
+  uint32_t now= millis();
+  scheduler.idle(50, ready);
+  TEST_ASSERT_EQUAL(now, millis());
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_one_shots);
+  RUN_TEST(test_one_shots_across_wrap);
+  RUN_TEST(test_periodic);
+  RUN_TEST(test_due_timers_change_each_other);
+  RUN_TEST(test_idle_ends_on_io);
+  return UNITY_END();
+}
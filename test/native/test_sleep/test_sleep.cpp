@@ -0,0 +1,131 @@
+//the learned sleep timeout over many deep sleep cycles: one-off transfers
+//shrink it, uploads in series grow it, and nothing makes it creep up
+#include <unity.h>
+#include <Arduino.h>
+#include "AdaptiveSleep.h"
+
+Config configuration(){
+  Config cfg;
+  loadDefaultConfiguration(cfg);
+  cfg.adaptsleep= 1;
+  cfg.sleeptimeout= 600;
+  cfg.sleepmin= 120;
+  cfg.sleepmax= 3600;
+  return cfg;
+}
+
+//a boot out of deep sleep: RAM is gone, RTC memory is kept
+uint32_t boot(AdaptiveSleep &sleep, const Config &cfg){
+  sleep= AdaptiveSleep();
+  sleep.begin(cfg);
+  return sleep.timeout();
+}
+
+
+void test_one_off_sessions_shrink(){
+  memset(ESP.rtc, 0, sizeof(ESP.rtc));
+  Config cfg= configuration();
+  AdaptiveSleep sleep;
+
+  //the user resets the adapter, sends one program right away, it times out
+  uint32_t last= boot(sleep, cfg);
+  TEST_ASSERT_EQUAL(600, last);
+  for(int cycle=0; cycle<20; cycle++){
+    sleep.sessionStart(5000);
+    sleep.sessionEnd(35000);
+    sleep.timedOut();
+    uint32_t timeout= boot(sleep, cfg);
+    TEST_ASSERT_LESS_OR_EQUAL(last, timeout);
+    last= timeout;
+  }
+  TEST_ASSERT_EQUAL(120, last);
+}
+
+
+//woken up by line noise, nobody connects: says nothing about the timeout
+void test_no_session_keeps_timeout(){
+  memset(ESP.rtc, 0, sizeof(ESP.rtc));
+  Config cfg= configuration();
+  AdaptiveSleep sleep;
+  boot(sleep, cfg);
+  for(int cycle=0; cycle<5; cycle++){
+    sleep.timedOut();
+    TEST_ASSERT_EQUAL(600, boot(sleep, cfg));
+  }
+}
+
+
+void test_series_grows(){
+  memset(ESP.rtc, 0, sizeof(ESP.rtc));
+  Config cfg= configuration();
+  AdaptiveSleep sleep;
+  boot(sleep, cfg);
+
+  //uploads every 8 minutes, a minute each, so 7 minutes apart
+  uint32_t now= 5000;
+  for(int n=0; n<6; n++){
+    sleep.sessionStart(now);
+    sleep.sessionEnd(now+60000);
+    now+= 8*60000;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(2*420+60, sleep.timeout());
+  TEST_ASSERT_EQUAL(sleep.timeout(), boot(sleep, cfg));     // kept across deep sleep
+}
+
+
+void test_power_cycle_starts_over(){
+  memset(ESP.rtc, 0, sizeof(ESP.rtc));
+  Config cfg= configuration();
+  AdaptiveSleep sleep;
+  boot(sleep, cfg);
+  sleep.sessionStart(5000);
+  sleep.sessionEnd(6000);
+  sleep.timedOut();
+  TEST_ASSERT_EQUAL(450, boot(sleep, cfg));
+
+  memset(ESP.rtc, 0x5a, sizeof(ESP.rtc));
+  TEST_ASSERT_EQUAL(600, boot(sleep, cfg));
+}
+
+
+//a new sleep setting replaces what was learned, also while asleep
+void test_new_sleep_starts_over(){
+  memset(ESP.rtc, 0, sizeof(ESP.rtc));
+  Config cfg= configuration();
+  AdaptiveSleep sleep;
+  boot(sleep, cfg);
+  sleep.sessionStart(5000);
+  sleep.sessionEnd(6000);
+  sleep.timedOut();
+  TEST_ASSERT_EQUAL(450, boot(sleep, cfg));
+
+  cfg.sleeptimeout= 900;
+  sleep.configure(cfg);
+  TEST_ASSERT_EQUAL(900, sleep.timeout());
+  TEST_ASSERT_EQUAL(900, boot(sleep, cfg));
+
+  //other items leave the learned timeout alone
+  sleep.sessionStart(5000);
+  sleep.sessionEnd(6000);
+  sleep.timedOut();
+  cfg.sleepmax= 3000;
+  sleep.configure(cfg);
+  TEST_ASSERT_EQUAL(675, sleep.timeout());
+
+  cfg.sleeptimeout= 300;
+  TEST_ASSERT_EQUAL(300, boot(sleep, cfg));
+}
+
+
+void setUp(){}
+void tearDown(){}
+
+int main(int argc, char **argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_one_off_sessions_shrink);
+  RUN_TEST(test_no_session_keeps_timeout);
+  RUN_TEST(test_series_grows);
+  RUN_TEST(test_power_cycle_starts_over);
+  RUN_TEST(test_new_sleep_starts_over);
+  return UNITY_END();
+}